@@ -0,0 +1,188 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <cctype>
+#include "BatchMode.h"
+#include "RunThreads.h"
+#include "EventWriter.h"
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+	size_t PhysicalMemory()
+	{
+#ifdef _WIN32
+		MEMORYSTATUSEX status{};
+		status.dwLength = sizeof(status);
+		if (GlobalMemoryStatusEx(&status)) {
+			return size_t(status.ullTotalPhys);
+		}
+		return 0;
+#else
+		long pages = sysconf(_SC_PHYS_PAGES), pagesize = sysconf(_SC_PAGE_SIZE);
+		return (pages > 0 && pagesize > 0) ? size_t(pages) * size_t(pagesize) : 0;
+#endif
+	}
+
+	std::string LowerExtension(const fs::path& p)
+	{
+		auto ext = p.extension().string();
+		std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+		return ext;
+	}
+
+	// .ptu or gzip compressed .ptu.gz
+	bool IsPTUFile(const fs::path& p)
+	{
+		auto ext = LowerExtension(p);
+		return ext == ".ptu" || (ext == ".gz" && LowerExtension(p.stem()) == ".ptu");
+	}
+}
+
+std::vector<std::string> CollectPTUFiles(const std::vector<std::string>& inputs)
+{
+	std::vector<std::string> files;
+	for (const auto& input : inputs) {
+		std::error_code ec;
+		if (fs::is_directory(input, ec)) {
+			for (auto it = fs::recursive_directory_iterator(input, fs::directory_options::skip_permission_denied, ec);
+				!ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+				if (it->is_regular_file(ec) && IsPTUFile(it->path())) {
+					files.push_back(it->path().string());
+				}
+			}
+		}
+		else {
+			files.push_back(input);
+		}
+	}
+	std::sort(files.begin(), files.end());
+	files.erase(std::unique(files.begin(), files.end()), files.end());
+	return files;
+}
+
+int RunBatch(const std::vector<std::string>& inputs, const ConversionOptions& options,
+	const BatchOptions& batch)
+{
+	auto files = CollectPTUFiles(inputs);
+	std::cout << "Found " << files.size() << " PTU files to convert." << std::endl;
+	unsigned int jobs = batch.jobs;
+	if (jobs == 0) {
+		jobs = std::max(1u, std::thread::hardware_concurrency());
+	}
+	jobs = std::max(1u, std::min(jobs, unsigned(std::max<size_t>(1, files.size()))));
+	size_t memory_limit = batch.memory_limit;
+	if (memory_limit == 0) {
+		memory_limit = std::max<size_t>(PhysicalMemory() / 2, 256 * 1024 * 1024);
+	}
+	MemoryBudget budget(memory_limit);
+	std::cout << "Converting with up to " << jobs << " jobs in parallel, using up to " <<
+		memory_limit / (1024 * 1024) << " MiB for histograms." << std::endl;
+
+	auto conversion_options = options;
+	conversion_options.show_progress = false;
+	// the jobs share the cores, so jobs x decoding threads does not exceed them
+	unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+	conversion_options.num_threads = std::max(1u, std::min(options.num_threads, cores / jobs));
+	if (conversion_options.num_threads < options.num_threads) {
+		std::cout << "Decoding with " << conversion_options.num_threads << " thread(s) per job." << std::endl;
+	}
+	auto plane_channels = PlaneChannels(options);
+	std::mutex console_mutex;
+	std::atomic<size_t> next_file{ 0 }, num_failed{ 0 }, num_skipped{ 0 };
+	RunThreads(jobs, [&](unsigned int) {
+		ConversionBuffers buffers; // reused for all files of this worker
+		for (size_t i = next_file++; i < files.size(); i = next_file++) {
+			fs::path infile(files[i]), target(infile), textfile(infile);
+			if (LowerExtension(infile) == ".gz") {
+				target.replace_extension(); // <name>.ptu.gz -> <name>.bin
+				textfile = target;
+			}
+			target.replace_extension(batch.ibw ? ".ibw" : ".bin");
+			textfile.replace_extension(".txt");
+			std::error_code ec;
+			auto targets = OutFileNames(target.string(), plane_channels);
+			for (auto& name : targets) {
+				if (options.frames_per_slice > 0 && !batch.ibw) {
+					name = SliceFileName(name, 0); // BIN time series
+				}
+				else if (!options.phasor_harmonics.empty() || options.intensity_mode) {
+					name = InsertBeforeExtension(name, "_int"); // first image of phasor / intensity mode
+				}
+				else if (options.event_mode) {
+					name = EventWriter::FileNames(EventBaseName(name), false).front();
+				}
+				else if (!options.gates.empty()) {
+					name = InsertBeforeExtension(name, "_gate1");
+				}
+			}
+			auto existing = std::find_if(targets.begin(), targets.end(), [&](const std::string& name) {
+				return fs::exists(name, ec);
+				});
+			if (existing != targets.end()) {
+				std::lock_guard<std::mutex> lock(console_mutex);
+				std::cout << "\nFile '" << *existing << "' exists. Skipping conversion for this file." << std::endl;
+				++num_skipped;
+				continue;
+			}
+			{
+				std::lock_guard<std::mutex> lock(console_mutex);
+				std::cout << "\n###############\nconverting " << infile.string() << " to " << target.string() << std::endl;
+			}
+			std::ostringstream log, err;
+			int res = EXIT_FAILURE;
+			try {
+				res = ConvertFile(infile.string(), target.string(), conversion_options, buffers, log, err, &budget);
+			}
+			catch (const std::exception& e) {
+				err << "ERROR: " << e.what() << std::endl;
+			}
+			// don't keep more memory around than our share of the budget
+			size_t kept_bytes = 0;
+			for (const auto& h : buffers.histograms) {
+				kept_bytes += h->bytes();
+			}
+			if (kept_bytes > memory_limit / jobs) {
+				buffers.histograms.clear();
+			}
+			bool report_ok = false;
+			if (res == EXIT_SUCCESS) {
+				std::ofstream report(textfile, std::ios::out);
+				report << log.str();
+				report_ok = report.good();
+			}
+			std::lock_guard<std::mutex> lock(console_mutex);
+			if (res != EXIT_SUCCESS) {
+				++num_failed;
+				std::cout << "An error occured while converting file '" << infile.string() << "'." << std::endl;
+				std::cout << "ERROR: " << err.str() << std::flush;
+			}
+			else {
+				std::cout << "conversion of " << infile.string() << " finished" << std::endl;
+				if (report_ok) {
+					std::cout << "output has been written to " << textfile.string() << std::endl;
+				}
+				else {
+					std::cout << "WARNING: could not write " << textfile.string() << std::endl;
+				}
+			}
+		}
+		});
+	std::cout << "\n" << files.size() - num_failed - num_skipped << " files converted, " << num_skipped <<
+		" skipped, " << num_failed << " failed." << std::endl;
+	return num_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
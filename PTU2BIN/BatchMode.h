@@ -0,0 +1,27 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+//
+// Batch conversion of many PTU files (replaces running PTU2BIN once per file).
+
+#pragma once
+#include <string>
+#include <vector>
+#include "Conversion.h"
+
+struct BatchOptions {
+	bool enabled{ false },
+		ibw{ false }; // write IBW instead of BIN files
+	unsigned int jobs = 0; // files converted in parallel, 0: all cores
+	size_t memory_limit = 0; // bytes for histograms of all jobs, 0: half of physical memory
+	std::string catalog; // not empty: write catalog of the headers to this file instead of converting
+};
+
+// PTU files given directly or found in the given directories (recursively), sorted
+std::vector<std::string> CollectPTUFiles(const std::vector<std::string>& inputs);
+
+// Converts all files on a pool of worker threads. As with convertPTUs.py,
+// <name>.ptu is converted to <name>.bin (or .ibw) unless that file already exists,
+// the report for each file is written to <name>.txt.
+// Returns EXIT_SUCCESS if all conversions were successful.
+int RunBatch(const std::vector<std::string>& inputs, const ConversionOptions& options,
+	const BatchOptions& batch);
@@ -0,0 +1,107 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+//
+// Bins the lines handed over by the decoder on a thread of its own, so decoding
+// and binning overlap. The photon vectors of the lines are passed on through a
+// ring and come back through a second ring to be reused.
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <utility>
+#include "SpscRing.h"
+#include "HistogramBinner.h"
+
+class BinnerThread
+{
+	struct Line {
+		int64_t linecounter{}, lineduration{};
+		std::vector<PixelTime> pixeltimes;
+	};
+	static constexpr int64_t STOP = -1; // linecounter of last Line
+	HistogramBinner& binner;
+	SpscRing<Line> lines, free_lines; // both can hold all lines
+	uint64_t lines_submitted;
+	std::atomic<uint64_t> lines_binned;
+	std::exception_ptr error;
+	std::thread thread;
+
+	void run()
+	{
+		for (;;) {
+			auto line = lines.pop();
+			if (line.linecounter == STOP) {
+				return;
+			}
+			if (!error) {
+				try {
+					binner.binLine(line.linecounter, line.lineduration, line.pixeltimes);
+				}
+				catch (...) {
+					error = std::current_exception(); // passed on by sync()
+				}
+			}
+			line.pixeltimes.clear();
+			free_lines.push(std::move(line));
+			lines_binned.store(lines_binned.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+			lines_binned.notify_one();
+		}
+	};
+public:
+	static constexpr size_t NUM_LINES = 64; // lines in flight
+
+	// binner must not be used otherwise until finish() has been called
+	explicit BinnerThread(HistogramBinner& Binner) : binner{ Binner }, lines(NUM_LINES), free_lines(NUM_LINES),
+		lines_submitted{ 0 }, lines_binned{ 0 }
+	{
+		for (size_t i = 0; i < NUM_LINES; ++i) {
+			free_lines.push(Line{});
+		}
+		thread = std::thread(&BinnerThread::run, this);
+	};
+	BinnerThread(const BinnerThread&) = delete;
+	BinnerThread& operator=(const BinnerThread&) = delete;
+	~BinnerThread()
+	{
+		if (thread.joinable()) {
+			lines.push(Line{ STOP, 0, {} });
+			thread.join();
+		}
+	};
+
+	// hands over the photons of a line, pixeltimes is swapped with an empty vector
+	void binLine(int64_t linecounter, int64_t lineduration, std::vector<PixelTime>& pixeltimes)
+	{
+		auto line = free_lines.pop();
+		line.linecounter = linecounter;
+		line.lineduration = lineduration;
+		std::swap(line.pixeltimes, pixeltimes);
+		lines.push(std::move(line));
+		++lines_submitted;
+	};
+	// waits until all lines handed over have been binned,
+	// afterwards the binner can be used by the calling thread until the next binLine()
+	void sync()
+	{
+		for (;;) {
+			auto binned = lines_binned.load(std::memory_order_acquire);
+			if (binned == lines_submitted) {
+				break;
+			}
+			lines_binned.wait(binned, std::memory_order_acquire);
+		}
+		if (error) {
+			std::rethrow_exception(std::exchange(error, nullptr));
+		}
+	};
+	// waits for all lines and stops the thread
+	void finish()
+	{
+		sync();
+		lines.push(Line{ STOP, 0, {} });
+		thread.join();
+	};
+};
@@ -0,0 +1,206 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <cmath>
+#include <cctype>
+#include <cstdio>
+#include "Catalog.h"
+#include "BatchMode.h"
+#include "PTUFileHeader.h"
+#include "CompressedInput.h"
+#include "RunThreads.h"
+
+namespace {
+	const char* const CSV_COLUMNS = "file,status,hw_type,version,measurement_mode,measurement_submode,"
+		"record_type,num_records,pix_x,pix_y,pix_resol_um,glob_res_s,resolution_s,filedate,bidirectional,"
+		"sin_correction,num_tags\n";
+
+	std::string CSVField(const std::string& s)
+	{
+		if (s.find_first_of(",\"\r\n") == std::string::npos) {
+			return s;
+		}
+		std::string quoted("\"");
+		for (char c : s) {
+			quoted += c;
+			if (c == '"') {
+				quoted += '"';
+			}
+		}
+		return quoted + '"';
+	}
+
+	std::string JSONString(std::string_view s)
+	{
+		std::string quoted("\"");
+		for (char c : s) {
+			switch (c) {
+			case '"': quoted += "\\\""; break;
+			case '\\': quoted += "\\\\"; break;
+			case '\n': quoted += "\\n"; break;
+			case '\r': quoted += "\\r"; break;
+			case '\t': quoted += "\\t"; break;
+			default:
+				if (uint8_t(c) < 0x20) {
+					char buf[8];
+					std::snprintf(buf, sizeof(buf), "\\u%04x", unsigned(c));
+					quoted += buf;
+				}
+				else {
+					quoted += c;
+				}
+			}
+		}
+		return quoted + '"';
+	}
+
+	std::string ISODate(time_t t)
+	{
+		return t == 0 ? std::string() : FormatUTCTime(t);
+	}
+
+	// reads the header of one file, returns its entry of the catalog
+	std::string CatalogEntry(const std::string& filename, bool json, bool& ok)
+	{
+		PTUFileHeader fh;
+		std::ostream nolog(nullptr);
+		std::ostringstream err;
+		std::string status = "ok";
+		ok = false;
+		try {
+			auto infile = OpenInFile(filename, IsGzipFile(filename));
+			if (!infile->good()) {
+				status = "cannot open file";
+			}
+			else if (!fh.ProcessFile(*infile, nolog, err)) {
+				status = err.str();
+				status.erase(status.find_last_not_of("\r\n") + 1);
+			}
+			else if (!fh.tags.hasHeaderEnd()) {
+				status = "header incomplete";
+			}
+			else {
+				ok = true;
+			}
+		}
+		catch (const std::exception& e) {
+			status = e.what();
+		}
+		const auto& tags = fh.tags;
+		std::vector<std::pair<const char*, std::string>> fields{
+			{ "hw_type", fh.hw_type },
+			{ "version", tags.fileVersion() },
+			{ "measurement_mode", std::to_string(fh.measurement_mode) },
+			{ "measurement_submode", std::to_string(fh.measurement_submode) },
+			{ "record_type", std::to_string(fh.record_type) },
+			{ "num_records", std::to_string(fh.num_records) },
+			{ "pix_x", std::to_string(fh.pix_x) },
+			{ "pix_y", std::to_string(fh.pix_y) },
+			{ "pix_resol_um", PTUTagTable::formatDouble(fh.PixResol) },
+			{ "glob_res_s", PTUTagTable::formatDouble(fh.GlobRes) },
+			{ "resolution_s", PTUTagTable::formatDouble(fh.Resolution) },
+			{ "filedate", ISODate(fh.filedate) },
+			{ "bidirectional", fh.is_bidirect ? "1" : "0" },
+			{ "sin_correction", std::to_string(fh.sin_correction) },
+			{ "num_tags", std::to_string(tags.size()) } };
+		std::string entry;
+		if (!json) {
+			entry = CSVField(filename) + ',' + CSVField(status);
+			for (const auto& f : fields) {
+				entry += ',' + CSVField(f.second);
+			}
+			return entry + '\n';
+		}
+		entry = "{\"file\": " + JSONString(filename) + ", \"status\": " + JSONString(status);
+		for (const auto& f : fields) {
+			bool is_text = f.first == std::string_view("hw_type") || f.first == std::string_view("version") ||
+				f.first == std::string_view("filedate");
+			entry += std::string(", \"") + f.first + "\": " + (is_text ? JSONString(f.second) : f.second);
+		}
+		entry += ",\n  \"tags\": {";
+		bool first = true;
+		for (const auto& tag : tags) {
+			if (tag.type == tyEmpty8) {
+				continue;
+			}
+			auto value = tags.valueText(tag);
+			if (tag.type == tyFloat8 && !std::isfinite(Int64ToDouble(tag.value))) {
+				value = "null";
+			}
+			else if (!PTUTagTable::isNumeric(tag)) {
+				value = JSONString(value);
+			}
+			entry += (first ? "" : ", ") + JSONString(tags.qualifiedName(tag)) + ": " + value;
+			first = false;
+		}
+		return entry + "}}";
+	}
+}
+
+int RunCatalog(const std::vector<std::string>& inputs, const std::string& outfilename, unsigned int jobs)
+{
+	auto files = CollectPTUFiles(inputs);
+	std::ostream& report = outfilename != "-" ? std::cout : std::cerr; // keep stdout for the catalog
+	report << "Found " << files.size() << " PTU files." << std::endl;
+	auto ext = std::filesystem::path(outfilename).extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+	bool json = ext == ".json";
+	std::ofstream outfile;
+	if (outfilename != "-") {
+		outfile.open(outfilename, std::ios::out | std::ios::binary);
+		if (!outfile.good()) {
+			std::cerr << "error opening outfile" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	std::ostream& out = outfilename != "-" ? static_cast<std::ostream&>(outfile) : std::cout;
+	out << (json ? "[\n" : CSV_COLUMNS);
+	if (jobs == 0) {
+		jobs = std::max(1u, std::thread::hardware_concurrency());
+	}
+	jobs = std::max(1u, std::min(jobs, unsigned(std::max<size_t>(1, files.size()))));
+
+	// entries are written in file order as soon as all previous ones are done
+	std::vector<std::string> entries(files.size());
+	std::vector<char> done(files.size(), 0);
+	std::mutex out_mutex;
+	size_t next_to_write = 0;
+	std::atomic<size_t> next_file{ 0 }, num_failed{ 0 };
+	RunThreads(jobs, [&](unsigned int) {
+		for (size_t i = next_file++; i < files.size(); i = next_file++) {
+			bool ok = false;
+			auto entry = CatalogEntry(files[i], json, ok);
+			if (!ok) {
+				++num_failed;
+			}
+			std::lock_guard<std::mutex> lock(out_mutex);
+			entries[i] = std::move(entry);
+			done[i] = 1;
+			for (; next_to_write < files.size() && done[next_to_write]; ++next_to_write) {
+				if (json) {
+					out << (next_to_write > 0 ? ",\n" : "") << entries[next_to_write];
+				}
+				else {
+					out << entries[next_to_write];
+				}
+				std::string().swap(entries[next_to_write]);
+			}
+		}
+		});
+	out << (json ? "\n]\n" : "") << std::flush;
+	if (!out.good()) {
+		std::cerr << "error writing catalog" << std::endl;
+		return EXIT_FAILURE;
+	}
+	report << "Catalog of " << files.size() << " files written, " << num_failed <<
+		" headers could not be read." << std::endl;
+	return num_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,16 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+//
+// Catalog of many PTU files: only the headers are read (up to Header_End),
+// on several threads, and written as one index (CSV or JSON).
+
+#pragma once
+#include <string>
+#include <vector>
+
+// Writes the catalog of all given PTU files and all PTU files found in the given
+// directories (recursively) to outfilename ("-": stdout). With extension .json,
+// all tags of each file are included, otherwise a CSV table of the main fields is written.
+// jobs: files read in parallel, 0: all cores.
+// Returns EXIT_SUCCESS if all headers could be read.
+int RunCatalog(const std::vector<std::string>& inputs, const std::string& outfilename, unsigned int jobs);
@@ -0,0 +1,147 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+//
+// Storage for the per pixel histograms of an image.
+// Counters are 16 bit. If a counter of a pixel wraps around, the pixel gets
+// a row in a 32 bit spill table that holds the high part of its counters.
+// The time axis starts with the number of channels we expect to be useful
+// and grows if a larger Dtime shows up (up to a limit).
+// The counters live in a LazyZeroBuffer, so untouched parts of the histogram
+// cost nothing, and the memory is reused by reset().
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <algorithm>
+#include "LazyZeroBuffer.h"
+
+class CompactHistogram
+{
+	size_t numpixels, channels, max_channels;
+	LazyZeroBuffer storage;
+	uint16_t* counts; // numpixels * channels, in storage
+	bool huge_pages{ false };
+	std::unordered_map<size_t, std::vector<uint32_t>> spill; // pixel -> high 16 bits of counters
+	std::mutex spill_mutex;
+
+	void carry(size_t pixel, uint32_t dt)
+	{
+		std::lock_guard<std::mutex> lock(spill_mutex);
+		auto& row = spill[pixel];
+		row.resize(channels);
+		++row[dt];
+	};
+public:
+	// Channels: initial length of time axis, Max_channels: max. length
+	CompactHistogram(size_t Numpixels, size_t Channels, size_t Max_channels) :
+		numpixels{ Numpixels }, channels{ std::min(Channels, Max_channels) }, max_channels{ Max_channels },
+		counts{ static_cast<uint16_t*>(storage.zeroed(numpixels * channels * sizeof(uint16_t))) } {};
+	CompactHistogram() : CompactHistogram(0, 0, 0) {};
+	CompactHistogram(const CompactHistogram&) = delete;
+	CompactHistogram& operator=(const CompactHistogram&) = delete;
+
+	// clear and set up for new image, keeps allocated memory if possible
+	void reset(size_t Numpixels, size_t Channels, size_t Max_channels)
+	{
+		numpixels = Numpixels;
+		max_channels = Max_channels;
+		channels = std::min(Channels, Max_channels);
+		counts = static_cast<uint16_t*>(storage.zeroed(numpixels * channels * sizeof(uint16_t), huge_pages));
+		spill.clear();
+	};
+	// give allocated memory back
+	void freeMemory()
+	{
+		reset(0, 0, 0);
+		storage.release();
+		counts = nullptr;
+	};
+	// use transparent huge pages (if available) from the next reset() on
+	void useHugePages(bool on) { huge_pages = on; };
+
+	size_t numChannels() const { return channels; };
+	size_t maxChannels() const { return max_channels; };
+	size_t numSpilledPixels() const { return spill.size(); };
+	size_t numPixels() const { return numpixels; };
+	// low 16 bits of all counters, pixel by pixel (numChannels() per pixel)
+	const uint16_t* counters() const { return counts; };
+	// pixel -> high 16 bits of its counters
+	const std::unordered_map<size_t, std::vector<uint32_t>>& spilledPixels() const { return spill; };
+	size_t bytes() const { return numpixels * channels * sizeof(uint16_t) + spill.size() * channels * sizeof(uint32_t); };
+
+	// count photon, returns false (and does not count) if dt is beyond current time axis.
+	// May be called concurrently for different pixels.
+	bool add(size_t pixel, uint32_t dt)
+	{
+		if (dt >= channels) {
+			return false;
+		}
+		if (++counts[pixel * channels + dt] == 0) {
+			carry(pixel, dt);
+		}
+		return true;
+	};
+	// set counter to value (not thread-safe, dt must be within current time axis)
+	void set(size_t pixel, uint32_t dt, uint32_t value)
+	{
+		counts[pixel * channels + dt] = uint16_t(value);
+		auto s = spill.find(pixel);
+		if (s != spill.end()) {
+			s->second[dt] = value >> 16;
+		}
+		else if (value > 0xffff) {
+			auto& row = spill[pixel];
+			row.resize(channels);
+			row[dt] = value >> 16;
+		}
+	};
+	// extend time axis to at least n channels (not thread-safe)
+	void grow(size_t n)
+	{
+		n = std::min(n, max_channels);
+		if (n <= channels) {
+			return;
+		}
+		n = std::min(max_channels, std::max(n, channels + channels / 2));
+		LazyZeroBuffer larger;
+		auto c = static_cast<uint16_t*>(larger.zeroed(numpixels * n * sizeof(uint16_t), huge_pages));
+		for (size_t p = 0; p < numpixels; ++p) {
+			std::copy_n(counts + p * channels, channels, c + p * n);
+		}
+		storage.swap(larger);
+		counts = c;
+		for (auto& s : spill) {
+			s.second.resize(n);
+		}
+		channels = n;
+	};
+	// counter values of channels 0 ... n-1 of pixel
+	void readPixel(size_t pixel, uint32_t* out, size_t n) const
+	{
+		n = std::min(n, channels);
+		const uint16_t* c = counts + pixel * channels;
+		std::copy_n(c, n, out);
+		if (!spill.empty()) {
+			auto s = spill.find(pixel);
+			if (s != spill.end()) {
+				for (size_t t = 0; t < n; ++t) {
+					out[t] += s->second[t] << 16;
+				}
+			}
+		}
+	};
+	uint32_t at(size_t pixel, size_t dt) const
+	{
+		uint32_t val = counts[pixel * channels + dt];
+		if (!spill.empty()) {
+			auto s = spill.find(pixel);
+			if (s != spill.end()) {
+				val += s->second[dt] << 16;
+			}
+		}
+		return val;
+	};
+};
@@ -0,0 +1,123 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+//
+// Reading gzip compressed PTU files (.ptu.gz) as a stream, without
+// decompressing them to disk first. Seeking is supported; seeking backwards
+// decompresses again from the start of the file, so it should be rare.
+
+#pragma once
+// 64 bit offsets in the decompressed data (z_off_t is 32 bit on Windows)
+#ifndef _LARGEFILE64_SOURCE
+#define _LARGEFILE64_SOURCE 1
+#endif
+#if defined(_WIN32) && !defined(_LFS64_LARGEFILE)
+#define _LFS64_LARGEFILE 1
+#endif
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+#ifdef Z_LARGE64
+using GzOffset = z_off64_t;
+inline GzOffset GzTell(gzFile file) { return gztell64(file); }
+inline GzOffset GzSeek(gzFile file, GzOffset offset) { return gzseek64(file, offset, SEEK_SET); }
+#else
+using GzOffset = z_off_t; // (64 bit where off_t is, e.g. macOS)
+inline GzOffset GzTell(gzFile file) { return gztell(file); }
+inline GzOffset GzSeek(gzFile file, GzOffset offset) { return gzseek(file, offset, SEEK_SET); }
+#endif
+
+class GzipStreamBuf : public std::streambuf
+{
+	gzFile file;
+	std::vector<char> buffer;
+protected:
+	int_type underflow() override
+	{
+		if (gptr() < egptr()) {
+			return traits_type::to_int_type(*gptr());
+		}
+		int n = gzread(file, buffer.data(), unsigned(buffer.size()));
+		if (n <= 0) {
+			return traits_type::eof();
+		}
+		setg(buffer.data(), buffer.data(), buffer.data() + n);
+		return traits_type::to_int_type(*gptr());
+	};
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override
+	{
+		if (!(which & std::ios_base::in) || dir == std::ios_base::end) {
+			return pos_type(off_type(-1));
+		}
+		off_type current = off_type(GzTell(file)) - off_type(egptr() - gptr());
+		off_type target = dir == std::ios_base::cur ? current + off : off;
+		if (target == current) {
+			return pos_type(current);
+		}
+		setg(buffer.data(), buffer.data(), buffer.data()); // discard buffered data
+		if (GzSeek(file, GzOffset(target)) != GzOffset(target)) {
+			return pos_type(off_type(-1));
+		}
+		return pos_type(target);
+	};
+	pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+	{
+		return seekoff(off_type(pos), std::ios_base::beg, which);
+	};
+public:
+	static constexpr size_t BUFFER_SIZE = size_t(1) << 18;
+	explicit GzipStreamBuf(const std::string& filename) : file{ gzopen(filename.c_str(), "rb") },
+		buffer(BUFFER_SIZE)
+	{
+		if (file) {
+			gzbuffer(file, unsigned(BUFFER_SIZE));
+		}
+		setg(buffer.data(), buffer.data(), buffer.data());
+	};
+	GzipStreamBuf(const GzipStreamBuf&) = delete;
+	GzipStreamBuf& operator=(const GzipStreamBuf&) = delete;
+	~GzipStreamBuf() override
+	{
+		if (file) {
+			gzclose(file);
+		}
+	};
+	bool isOpen() const { return file != nullptr; };
+};
+
+class GzipIStream : public std::istream
+{
+	GzipStreamBuf buf;
+public:
+	explicit GzipIStream(const std::string& filename) : std::istream(nullptr), buf(filename)
+	{
+		rdbuf(&buf);
+		if (!buf.isOpen()) {
+			setstate(std::ios_base::failbit);
+		}
+	};
+};
+
+// true if the file starts with the gzip magic bytes
+inline bool IsGzipFile(const std::string& filename)
+{
+	std::ifstream f(filename, std::ios::in | std::ios::binary);
+	unsigned char magic[2]{};
+	f.read((char*)magic, 2);
+	return f.good() && magic[0] == 0x1f && magic[1] == 0x8b;
+}
+
+// opens a PTU file, decompressing it on the fly if it is gzip compressed
+inline std::unique_ptr<std::istream> OpenInFile(const std::string& filename, bool compressed)
+{
+	if (compressed) {
+		return std::make_unique<GzipIStream>(filename);
+	}
+	return std::make_unique<std::ifstream>(filename, std::ios::in | std::ios::binary);
+}
@@ -0,0 +1,1148 @@
+// Conversion of a PTU file to BIN or IBW (see Conversion.h)
+//
+// (c) 2021 - 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+// 
+// Some parts are based on demo code from PicoQuant
+// (see their GitHub repo)
+//
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <filesystem>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <cstdio>
+//#include <numbers>
+#ifndef __STDC_WANT_LIB_EXT1__
+#define __STDC_WANT_LIB_EXT1__
+#endif
+#include <ctime>
+#include "PTUFileHeader.h"
+#include "TTTRRecordProcessor.h"
+#include "RecordBuffer.h"
+#include "PipelinedRecordBuffer.h"
+#include "CompressedInput.h"
+#include "SparseBin.h"
+#include "EventWriter.h"
+#include "BinnerThread.h"
+#include "MappedRecordBuffer.h"
+#include "LineFrameTracker.h"
+#include "CompactHistogram.h"
+#include "HistogramBinner.h"
+#include "ParallelDecoder.h"
+#include "MarkerIndex.h"
+#include "RecordClassifier.h"
+#include "TriggerAnalyzer.h"
+#include "Conversion.h"
+#include "PhasorImage.h"
+#include "MeanTimeImage.h"
+#include "RunThreads.h"
+
+//#define	DOPERFORMANCEANALYSIS
+#ifdef DOPERFORMANCEANALYSIS
+#include <chrono>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+// page faults (minor and major) of the process so far, -1 if not available
+static int64_t PageFaults()
+{
+#ifdef _WIN32
+	return -1;
+#else
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+	return int64_t(usage.ru_minflt) + int64_t(usage.ru_majflt);
+#endif
+}
+#endif // DOPERFORMANCEANALYSIS
+
+#pragma pack(8)
+
+extern int ExportIBWFile(std::ostream& os, const CompactHistogram& histogram, int64_t pix_x,
+	int64_t pix_y, double res_space, double res_time,
+	int64_t max_export_channel, const std::string& wavename, time_t filedate, unsigned int num_threads = 1);
+extern bool IBWWaveFits(int64_t npnts, size_t element_size);
+extern int WriteIBWHeader(std::ostream& os, int64_t pix_x, int64_t pix_y, double res_space, double res_time,
+	int64_t num_channels, int64_t num_slices, const std::string& wavename, time_t filetime);
+extern int WriteIBWImage(std::ostream& os, const CompactHistogram& histogram, int64_t num_channels,
+	unsigned int num_threads = 1);
+extern int WriteIBWBand(std::ostream& os, std::streamoff data_start, const CompactHistogram& histogram,
+	int64_t pix_x, int64_t pix_y, int64_t first_line, int64_t num_channels, unsigned int num_threads = 1,
+	size_t max_buffer_bytes = std::numeric_limits<size_t>::max());
+template<class T> extern int ExportIBWImage(std::ostream& os, const T* data, int64_t pix_x, int64_t pix_y,
+	double res_space, const std::string& wavename, time_t filetime);
+
+struct BinHeader {
+	uint32_t PixX, PixY;
+	float PixResol;
+	uint32_t TCSPCChannels;
+	float TimeResol;
+};
+
+// write BIN header
+int WriteBinHeader(std::ostream& os, int64_t pix_x, int64_t pix_y, double res_space, double res_time, int64_t max_used_channel)
+{
+	BinHeader bh{};
+	bh.PixX = (uint32_t)pix_x;
+	bh.PixY = (uint32_t)pix_y;
+	bh.PixResol = (float)res_space;
+	bh.TCSPCChannels = (uint32_t)max_used_channel;
+	bh.TimeResol = (float)(res_time * 1e9); // in ns
+	os.write((char*)& bh, sizeof(bh));
+	return !os.good();
+}
+
+// pixels compacted at once before they are written, and the least number of counters
+// per thread worth starting a thread for
+constexpr size_t MAX_STAGING_BYTES = 4 * 1024 * 1024, MIN_COUNTERS_PER_THREAD = 1 << 18;
+
+// write the pixels of histogram (lines of pix_x pixels) in BIN format, without header.
+// The counters of a group of pixels are copied (on num_threads threads) from the padded
+// rows of the histogram to a staging buffer, which is written in one go.
+int WriteBinPixels(std::ostream& os, const CompactHistogram& histogram, int64_t pix_x, int64_t pix_y, int64_t max_used_channel,
+	unsigned int num_threads)
+{
+	const size_t numpixels = size_t(pix_x * pix_y), out_channels = size_t(max_used_channel),
+		channels = histogram.numChannels(), n = std::min(out_channels, channels);
+	const uint16_t* counters = histogram.counters();
+	if (numpixels == 0 || out_channels == 0) {
+		return !os.good();
+	}
+	size_t group = std::clamp<size_t>(MAX_STAGING_BYTES / (sizeof(uint32_t) * out_channels), 1, numpixels);
+	std::vector<uint32_t> staging(group * out_channels); // channels beyond the histogram's stay 0
+	// pixels with counters beyond 16 bit, in pixel order
+	std::vector<std::pair<size_t, const uint32_t*>> spilled;
+	for (const auto& s : histogram.spilledPixels()) {
+		spilled.emplace_back(s.first, s.second.data());
+	}
+	std::sort(spilled.begin(), spilled.end());
+	auto next_spilled = spilled.begin();
+	for (size_t p0 = 0; p0 < numpixels; p0 += group) {
+		size_t count = std::min(group, numpixels - p0);
+		unsigned int threads = unsigned(std::clamp<size_t>(count * n / MIN_COUNTERS_PER_THREAD, 1, std::max(1u, num_threads)));
+		size_t slice = (count + threads - 1) / threads;
+		RunThreads(threads, [&](unsigned int thread) {
+			size_t pbegin = std::min(count, thread * slice), pend = std::min(count, pbegin + slice);
+			for (size_t p = pbegin; p < pend; ++p) {
+				std::copy_n(counters + (p0 + p) * channels, n, staging.data() + p * out_channels);
+			}
+			});
+		// add high parts of counters that went beyond 16 bit
+		for (; next_spilled != spilled.end() && next_spilled->first < p0 + count; ++next_spilled) {
+			uint32_t* out = staging.data() + (next_spilled->first - p0) * out_channels;
+			for (size_t t = 0; t < n; ++t) {
+				out[t] += next_spilled->second[t] << 16;
+			}
+		}
+		os.write((char*)staging.data(), sizeof(uint32_t) * count * out_channels);
+		if (!os.good()) {
+			return 1;
+		}
+	}
+	return 0; // success
+}
+
+// write histogram data in BIN format
+int ExportBinFile(std::ostream& os, const CompactHistogram& histogram, int64_t pix_x, int64_t pix_y, double res_space, double res_time, int64_t max_used_channel,
+	unsigned int num_threads = 1)
+{
+	if (WriteBinHeader(os, pix_x, pix_y, res_space, res_time, max_used_channel) != 0) {
+		return 1;
+	}
+	return WriteBinPixels(os, histogram, pix_x, pix_y, max_used_channel, num_threads);
+}
+
+// write image in BIN format, as a histogram with a single time channel
+// (data is uint32_t or float)
+template<class T> int ExportBinImage(std::ostream& os, const T* data, int64_t pix_x, int64_t pix_y, double res_space, double res_time)
+{
+	BinHeader bh{};
+	bh.PixX = (uint32_t)pix_x;
+	bh.PixY = (uint32_t)pix_y;
+	bh.PixResol = (float)res_space;
+	bh.TCSPCChannels = 1;
+	bh.TimeResol = (float)(res_time * 1e9); // in ns
+	os.write((char*)& bh, sizeof(bh));
+	os.write((const char*)data, sizeof(T) * pix_x * pix_y);
+	return !os.good();
+}
+
+// name of IBW wave written to file
+std::string WaveName(const std::string& filename, std::ostream& log)
+{
+	auto dot = filename.find_last_of('.'), lastslash = filename.find_last_of("/\\");
+	std::string wavename("");
+	if (lastslash != std::string::npos) {
+		wavename = filename.substr(lastslash + 1, dot - lastslash - 1);
+	}
+	else {
+		wavename = filename.substr(0, dot);
+	}
+	char firstchar = wavename.at(0);
+	if (!std::isalpha(firstchar) && firstchar!='_') {
+		wavename = "_" + wavename;
+		log << "wavename amended -> " << wavename << std::endl;
+	}
+	return wavename;
+}
+
+// convert sparse BIN file back to BIN or IBW (depending on extension of outfilename)
+int ExpandSparseBinFile(const std::string& infilename, const std::string& outfilename,
+	std::ostream& log, std::ostream& err)
+{
+	std::ifstream infile(infilename, std::ios::in | std::ios::binary);
+	SparseBinHeader sh{};
+	CompactHistogram histogram;
+	if (!infile.good() || !ReadSparseBinFile(infile, sh, histogram)) {
+		err << "error reading sparse BIN file " << infilename << std::endl;
+		return EXIT_FAILURE;
+	}
+	log << "Expanding " << infilename << " (" << sh.NumEntries << " non-zero entries) to " << outfilename << std::endl;
+	auto dot = outfilename.find_last_of('.');
+	bool ibw = dot != std::string::npos && outfilename.substr(dot + 1) == "ibw";
+	double res_time = sh.TimeResolution;
+	unsigned int num_threads = std::max(1u, std::thread::hardware_concurrency());
+	std::ofstream outfile(outfilename, std::ios::out | std::ios::binary);
+	int res = !outfile.good() || (ibw ?
+		ExportIBWFile(outfile, histogram, sh.PixX, sh.PixY, sh.PixResol, res_time, sh.TCSPCChannels,
+			WaveName(outfilename, log), sh.FileDate ? time_t(sh.FileDate) : std::time(nullptr), num_threads) :
+		ExportBinFile(outfile, histogram, sh.PixX, sh.PixY, sh.PixResol, res_time, sh.TCSPCChannels, num_threads)) != 0;
+	outfile.close();
+	if (res != 0) {
+		err << "Error while writing outfile." << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+int ConvertFile(const std::string& infilename, const std::string& outfilename,
+	const ConversionOptions& options, ConversionBuffers& buffers,
+	std::ostream& log, std::ostream& err, MemoryBudget* budget)
+{
+	auto plane_channels = PlaneChannels(options);
+	// photons of other channels are dropped right away, before they reach the binner
+	int channelofinterest = plane_channels.size() == 1 ? plane_channels.front() : -1;
+	int64_t lines_to_skip = options.lines_to_skip;
+	bool event_mode = options.event_mode;
+	const FrameSelection all_frames;
+	const auto& frames = (event_mode && !options.event_filter) ? all_frames : options.frames;
+	bool ignore_frame_trigger = options.ignore_frame_trigger, use_mmap = options.use_mmap,
+		use_index = options.use_index, isterminal = options.show_progress;
+	unsigned int num_threads = options.num_threads;
+	int64_t frames_per_slice = options.frames_per_slice;
+	bool time_series = frames_per_slice > 0;
+	const auto& harmonics = options.phasor_harmonics;
+	bool phasor_mode = !harmonics.empty(), intensity_mode = options.intensity_mode;
+	const auto& gates = options.gates;
+	bool gate_mode = !gates.empty();
+	auto outfilenames = event_mode ? EventWriter::FileNames(EventBaseName(outfilename), options.event_macrotime) :
+		OutFileNames(outfilename, plane_channels);
+	log << "infile: " << infilename << "\noutfile: " << outfilenames.front() << std::endl;
+	for (size_t p = 1; p < outfilenames.size(); ++p) {
+		log << "         " << outfilenames[p] << std::endl;
+	}
+	bool compressed = IsGzipFile(infilename);
+	auto input = OpenInFile(infilename, compressed);
+	auto& infile = *input;
+	PTUFileHeader fh;
+	if (!infile.good()) {
+		err << "error opening infile" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (!fh.ProcessFile(infile, log, err)) {
+		err << "error processing file headers" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (!infile.good()) {
+		err << "error while reading file headers\n";
+		return EXIT_FAILURE;
+	}
+	if (fh.measurement_submode != 3) {
+		// NOTE: "Measurement_SubMode" is mandatory, so we assume it is set in PTU file 
+		err << "ERROR: Submode " << Measurement_SubModes.at(fh.measurement_submode) <<
+			" not supported. Must be 'Image'." << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (fh.dimensions != 3 && fh.dimensions != -1) {
+		err << "ERROR: " << fh.dimensions << " dimensions not supported. Must be 3." << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (!fh.allNeededPresent()) {
+		err << "ERROR: some data missing from PTU file header" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (fh.sin_correction != 0) {
+		log << 
+			"NOTE: ImgHdr_SinCorrection is " << fh.sin_correction << '%' << std::endl;
+	}
+	//
+	// we are done checking the file header, now let's init processing
+	auto record_format = GetRecordFormat(fh.record_type);
+	if (record_format == RecordFormat::unknown) {
+		err << "Unexpected record type." << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (IsT2Format(record_format) || fh.measurement_mode != 3) {
+		err << "Sorry, T2 mode not supported (working on it)." << std::endl;
+		return EXIT_FAILURE;
+	}
+	constexpr double MAX_TRIGGER_DIFF_SEC = 120e-6;
+	int max_trig_diff = 0;
+	if (fh.GlobRes > 1e-9) {
+		max_trig_diff = int(MAX_TRIGGER_DIFF_SEC / fh.GlobRes);
+	}
+	int num_useful_histo_ch = int(std::ceil(fh.GlobRes / fh.Resolution)) + 1; // TODO: check if ok for T2 data
+	// with binning, the image and its time axis are smaller than in the file
+	int64_t bin_xy = options.bin_xy, bin_t = options.bin_t;
+	int64_t img_x = HistogramBinner::BinnedSize(fh.pix_x, bin_xy), img_y = HistogramBinner::BinnedSize(fh.pix_y, bin_xy);
+	double img_pixresol = fh.PixResol * double(bin_xy), img_resolution = fh.Resolution * double(bin_t);
+	if (bin_xy > 1 || bin_t > 1) {
+		num_useful_histo_ch = int(HistogramBinner::BinnedSize(num_useful_histo_ch, bin_t));
+		log << "binning " << bin_xy << 'x' << bin_xy << " pixels, " << bin_t << " time channels -> image "
+			<< img_x << 'x' << img_y << std::endl;
+	}
+	log << "estimated number of useful histogram channels: " << num_useful_histo_ch << std::endl;
+	log << "total # records in file: " << fh.num_records << std::endl;
+	if (plane_channels.size() > 1) {
+		log << "Evaluating " << plane_channels.size() << " channels in one pass." << std::endl;
+	}
+	else if (channelofinterest >= 0) {
+		log << "Evaluating channel " << (channelofinterest + 1) << " only." << std::endl;
+	}
+	else
+	{
+		log << "Evaluating all channels." << std::endl;
+	}
+
+
+	auto& pixeltimes = buffers.pixeltimes;
+	pixeltimes.reserve(32768); // Perf. test shows only small effect of this
+
+	// decide on the file format for export depending on the file extension given in the command line
+	auto poslastdot = outfilename.find_last_of('.');
+	std::string extension("bin"); // default to bin file
+	if (poslastdot != std::string::npos) {
+		extension = outfilename.substr(poslastdot + 1);
+	}
+	bool exporting_ibw = extension == "ibw";
+	bool exporting_sparse = extension == "sbin";
+	if (exporting_sparse && (phasor_mode || intensity_mode || gate_mode || event_mode)) {
+		err << "ERROR: the sparse format is for histograms only" << std::endl;
+		return EXIT_FAILURE;
+	}
+	auto get_wavename = [&](const std::string& name) {
+		return WaveName(name, log);
+	};
+	auto export_bin = [&](std::ostream& os, const CompactHistogram& histogram, int64_t export_channels) {
+		return exporting_sparse ?
+			ExportSparseBinFile(os, histogram, img_x, img_y, img_pixresol, img_resolution, export_channels, fh.filedate) :
+			ExportBinFile(os, histogram, img_x, img_y, img_pixresol, img_resolution, export_channels, num_threads);
+	};
+
+#ifdef DOPERFORMANCEANALYSIS
+	auto setup_start = std::chrono::steady_clock::now();
+	auto setup_faults = PageFaults();
+#endif
+	// space for histogramm data
+	size_t max_hist_channels = std::max(512, num_useful_histo_ch); // number of histogramm channels, same as max Dtime?
+	if (time_series && exporting_ibw) {
+		// all slices of the 4D wave need the same time axis, it can not grow
+		max_hist_channels = size_t(num_useful_histo_ch);
+		log << "time series: " << frames_per_slice << " frame(s) per slice, " << num_useful_histo_ch <<
+			" time channels (photons with larger Dtime are not counted)" << std::endl;
+	}
+	else if (time_series) {
+		log << "time series: " << frames_per_slice << " frame(s) per slice" << std::endl;
+	}
+	// With a memory limit, a histogram that does not fit is made in bands of lines,
+	// one pass over the file per band. The time axis of a band has full length
+	// right away (it never grows), so its size is known in advance.
+	int64_t band_lines = img_y;
+	bool histogram_mode = !(phasor_mode || intensity_mode || gate_mode || event_mode);
+	if (options.max_memory > 0 && histogram_mode) {
+		size_t line_bytes = plane_channels.size() * size_t(img_x) * max_hist_channels * sizeof(uint16_t);
+		if (exporting_ibw) {
+			// writing a band re-orders at least one time channel of it
+			line_bytes += size_t(img_x) * sizeof(uint32_t);
+		}
+		band_lines = std::min(img_y, int64_t(options.max_memory / line_bytes));
+		if (band_lines < 1) {
+			err << "ERROR: max. memory is too small for a single line of the histogram (" <<
+				(line_bytes + 1024 * 1024 - 1) / (1024 * 1024) << " MiB)" << std::endl;
+			return EXIT_FAILURE;
+		}
+		if (band_lines < img_y && (time_series || exporting_sparse)) {
+			err << "ERROR: histogram exceeds max. memory, this is not supported for time series and sparse BIN files" << std::endl;
+			return EXIT_FAILURE;
+		}
+		if (band_lines < img_y) {
+			log << "histogram exceeds max. memory, processing " << HistogramBinner::BinnedSize(img_y, band_lines) <<
+				" bands of " << band_lines << " lines (one pass each)" << std::endl;
+		}
+	}
+	bool banded = band_lines < img_y;
+	if (banded && exporting_ibw && !IBWWaveFits(img_x * img_y * num_useful_histo_ch, sizeof(uint32_t))) {
+		// (checked before the passes, with the estimated number of channels)
+		err << "ERROR: histogram is too large for an IBW file (2 GiB max.), use BIN output instead" << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::optional<MemoryBudget::Reservation> reservation;
+	if (budget) {
+		size_t bytes_per_pixel = event_mode ? 0 : phasor_mode ? sizeof(uint32_t) + 2 * harmonics.size() * sizeof(double) :
+			intensity_mode ? sizeof(uint32_t) + sizeof(uint64_t) :
+			gate_mode ? gates.size() * sizeof(uint32_t) :
+			max_hist_channels * sizeof(uint16_t); // the time axis may grow up to max_hist_channels
+		reservation.emplace(*budget, plane_channels.size() * size_t(img_x * band_lines) * bytes_per_pixel);
+	}
+	std::vector<CompactHistogram*> planes;
+	std::vector<PhasorImage*> phasor_planes;
+	std::vector<MeanTimeImage*> meantime_planes;
+	std::vector<GateImages*> gate_planes;
+	std::optional<EventWriter> event_writer;
+	if (event_mode) {
+		event_writer.emplace(EventBaseName(outfilename), options.event_macrotime);
+		if (!event_writer->good()) {
+			err << " error opening outfile\n";
+			return EXIT_FAILURE;
+		}
+		if (options.event_filter) {
+			log << "Writing events of the selected frames and channels." << std::endl;
+		}
+		else {
+			log << "Writing events of all frames and channels." << std::endl;
+		}
+	}
+	else if (gate_mode) {
+		for (size_t g = 0; g < gates.size(); ++g) {
+			auto first = GateImages::firstDtime(gates[g], img_resolution * 1e9),
+				end = GateImages::endDtime(gates[g], img_resolution * 1e9);
+			log << "gate " << g + 1 << ": " << gates[g].start << " - " << gates[g].end << " ns (Dtime ";
+			if (end > first) {
+				log << first << " - " << end - 1 << ")" << std::endl;
+			}
+			else {
+				log << "none)" << std::endl;
+			}
+		}
+		auto& gateimages = buffers.gateimages;
+		gateimages.resize(plane_channels.size());
+		for (auto& gateimage : gateimages) {
+			if (!gateimage) {
+				gateimage = std::make_unique<GateImages>();
+			}
+			gateimage->reset(size_t(img_x * img_y), max_hist_channels, gates, img_resolution * 1e9);
+			gate_planes.push_back(gateimage.get());
+		}
+	}
+	else if (intensity_mode) {
+		auto& meantimes = buffers.meantimes;
+		meantimes.resize(plane_channels.size());
+		for (auto& meantime : meantimes) {
+			if (!meantime) {
+				meantime = std::make_unique<MeanTimeImage>();
+			}
+			meantime->reset(size_t(img_x * img_y), max_hist_channels);
+			meantime_planes.push_back(meantime.get());
+		}
+	}
+	else if (phasor_mode) {
+		auto& phasors = buffers.phasors;
+		phasors.resize(plane_channels.size());
+		for (auto& phasor : phasors) {
+			if (!phasor) {
+				phasor = std::make_unique<PhasorImage>();
+			}
+			phasor->reset(size_t(img_x * img_y), max_hist_channels, harmonics, img_resolution, fh.GlobRes);
+			phasor_planes.push_back(phasor.get());
+		}
+	}
+	else {
+		// time axis starts with the useful channels and grows if needed
+		auto& histograms = buffers.histograms;
+		histograms.resize(plane_channels.size());
+		for (auto& histogram : histograms) {
+			if (!histogram) {
+				histogram = std::make_unique<CompactHistogram>();
+			}
+			histogram->useHugePages(options.huge_pages);
+			histogram->reset(size_t(img_x * band_lines), banded ? max_hist_channels : size_t(num_useful_histo_ch),
+				max_hist_channels);
+			planes.push_back(histogram.get());
+		}
+	}
+	HistogramBinner binner = event_mode ? HistogramBinner::EventMapper(plane_channels, fh) :
+		phasor_mode ? HistogramBinner(phasor_planes, plane_channels, fh) :
+		intensity_mode ? HistogramBinner(meantime_planes, plane_channels, fh) :
+		gate_mode ? HistogramBinner(gate_planes, plane_channels, fh) :
+		HistogramBinner(planes, plane_channels, fh);
+	binner.setBinning(bin_xy, bin_t);
+#ifdef DOPERFORMANCEANALYSIS
+	std::chrono::duration<double> setup_diff = std::chrono::steady_clock::now() - setup_start;
+	log << "PERF-TEST: histogram setup: " << setup_diff.count() << " s, " << PageFaults() - setup_faults <<
+		" page faults" << std::endl;
+#endif
+	// with a pipeline, the lines are binned on a thread of its own
+	std::optional<BinnerThread> binner_stage;
+
+	int frame_trg_type = FRAMETRG_UNKNOW;
+	std::optional<LineFrameTracker> tracker; // set up once frame trigger type is known
+
+	// In time series mode, a slice is written as soon as its last frame has been
+	// processed, so only the histogram of one slice is kept in memory.
+	// The IBW headers are written again with the number of slices when we are done.
+	std::vector<std::ofstream> stacks; // IBW time series, one per plane
+	std::vector<std::string> wavenames;
+	std::vector<uint32_t> series_maxDtime(plane_channels.size(), 0);
+	int64_t num_slices = 0;
+	if (time_series && exporting_ibw) {
+		if (!IBWWaveFits(img_x * img_y * num_useful_histo_ch, sizeof(uint32_t))) {
+			err << "ERROR: a slice is too large for an IBW file (2 GiB max.), use BIN output instead" << std::endl;
+			return EXIT_FAILURE;
+		}
+		for (const auto& name : outfilenames) {
+			wavenames.push_back(get_wavename(name));
+			stacks.emplace_back(name.c_str(), std::ios::out | std::ios::binary);
+			if (!stacks.back().good() || WriteIBWHeader(stacks.back(), img_x, img_y, img_pixresol, img_resolution,
+				num_useful_histo_ch, 0, wavenames.back(), fh.filedate) != 0) {
+				err << " error opening outfile\n";
+				return EXIT_FAILURE;
+			}
+		}
+	}
+	int64_t frames_in_slice = 0, frame_start_lines = 0, slice_start_lines = 0; // (start: in lines processed)
+	auto write_slice = [&]() {
+		if (binner_stage) {
+			binner_stage->sync();
+		}
+		binner.flush();
+		for (size_t p = 0; p < planes.size(); ++p) {
+			int res = 0;
+			if (exporting_ibw) {
+				if (!IBWWaveFits(img_x * img_y * num_useful_histo_ch * (num_slices + 1), sizeof(uint32_t))) {
+					throw std::runtime_error("IBW time series exceeds 2 GiB after " + std::to_string(num_slices) +
+						" slice(s), use BIN output (one file per slice) instead");
+				}
+				res = WriteIBWImage(stacks[p], *planes[p], num_useful_histo_ch, num_threads);
+			}
+			else {
+				std::ofstream outfile(SliceFileName(outfilenames[p], num_slices).c_str(), std::ios::out | std::ios::binary);
+				res = !outfile.good() || export_bin(outfile, *planes[p], int64_t(binner.maxDtime[p]) + 1) != 0;
+			}
+			if (res != 0) {
+				throw std::runtime_error("error while writing slice " + std::to_string(num_slices));
+			}
+			series_maxDtime[p] = std::max(series_maxDtime[p], binner.maxDtime[p]);
+			binner.maxDtime[p] = 0;
+			planes[p]->reset(size_t(img_x * img_y), size_t(num_useful_histo_ch), max_hist_channels);
+		}
+		++num_slices;
+		frames_in_slice = 0;
+		slice_start_lines = tracker->linesprocessed;
+	};
+
+#ifdef DOPERFORMANCEANALYSIS
+	auto start_time = std::chrono::steady_clock::now();
+	auto start_faults = PageFaults();
+#endif
+	// prepare input buffer, prefer mapping the file (saves us copying the records around)
+	size_t records_offset = size_t(infile.tellg());
+	RecordBuffer stream_buffer(infile, fh.num_records);
+	std::unique_ptr<MappedRecordBuffer> mapped_buffer;
+	std::optional<PipelinedRecordBuffer> pipelined_buffer;
+	if (options.pipeline || compressed) {
+		// reader, decoder (this thread) and binner stages,
+		// a compressed file is always decompressed by the reader ahead of the decoder
+		if (options.pipeline && !event_mode) {
+			log << "Decoding in a pipeline of 3 threads." << std::endl;
+			binner_stage.emplace(binner);
+		}
+		if (compressed) {
+			log << "Decompressing infile on the fly." << std::endl;
+		}
+		pipelined_buffer.emplace(infile, fh.num_records);
+	}
+	else if (use_mmap) {
+		try {
+			mapped_buffer = std::make_unique<MappedRecordBuffer>(infilename, records_offset, fh.num_records);
+		}
+		catch (std::exception& e) {
+			log << "NOTE: cannot map infile (" << e.what() << "), using buffered reading" << std::endl;
+		}
+	}
+	if (num_threads > 1) {
+		if (time_series || event_mode) {
+			log << "NOTE: time series and events are decoded with a single thread" << std::endl;
+		}
+		else if (mapped_buffer) {
+			log << "Decoding with " << num_threads << " threads." << std::endl;
+		}
+		else {
+			log << "NOTE: multi-threaded decoding needs memory mapped infile, using single thread" << std::endl;
+		}
+	}
+	// with a valid index, we can jump right to the selected frames,
+	// otherwise the index is built while processing the file
+	MarkerIndex index;
+	bool have_index = false, build_index = false;
+	if (use_index) {
+		std::error_code ec;
+		auto filesize = std::filesystem::file_size(infilename, ec);
+		MarkerIndex expected(fh, filesize, records_offset, FRAMETRG_UNKNOW, lines_to_skip, ignore_frame_trigger);
+		have_index = !ec && index.load(MarkerIndexFileName(infilename), expected.key);
+		if (have_index) {
+			log << "Using frame index " << MarkerIndexFileName(infilename) << std::endl;
+		}
+		else {
+			index = expected;
+			build_index = !ec;
+		}
+	}
+	bool save_index = build_index;
+	if (banded && !have_index && !build_index) {
+		// the frames found in the first pass let the following passes skip unused frames
+		index = MarkerIndex(fh, 0, records_offset, FRAMETRG_UNKNOW, lines_to_skip, ignore_frame_trigger);
+		index.frames_only = true;
+		build_index = true;
+	}
+
+	//////////////
+	// start processing of records
+	// (works with either type of buffer)
+	// (the processor is specialized for the record format of the file)
+	// Handles special record at position recpos, has_next / next_record tell about the
+	// record following it. Returns true if the next record got merged (i.e. consumed).
+	auto process_special = [&](auto& processor, uint32_t TTTRRecord, uint64_t recpos,
+		bool has_next, uint32_t next_record) {
+		if (processor.processOverflow(TTTRRecord)) //overflow
+		{
+			return false;
+		}
+		auto trigger = processor.markers(TTTRRecord);
+		bool merged = false;
+		// test if next record is also a marker event
+		if (has_next && processor.isMarker(next_record) &&
+			(processor.nsync(next_record) - processor.nsync(TTTRRecord) <= max_trig_diff)) {
+			merged = true;
+			trigger |= processor.markers(next_record); // merge marker events
+#ifndef NDEBUG
+			log << "marker events merged" << std::endl;
+#endif // !NDEBUG
+		}
+		// for the time being, we assume that any special record that is not an overflow
+		// is a marker record.
+		auto truensync = processor.truesync(TTTRRecord);
+		auto framecounter = tracker->framecounter;
+		auto events = tracker->processMarker(trigger, truensync);
+		if (build_index) {
+			if (events & LineFrameTracker::LINE_STARTED) {
+				index.addLine(recpos, truensync, processor.overflowCorrection(), tracker->state());
+			}
+			if (tracker->framecounter != framecounter) {
+				index.addFrame(recpos + (merged ? 2 : 1), processor.overflowCorrection(), tracker->state());
+			}
+		}
+		if (events & LineFrameTracker::LINE_ENDED) {
+			// process line data:
+			if (tracker->ended_line >= 0 && event_writer) {
+				// (framecounter has been counted up already if the line completed the frame)
+				event_writer->addLine(binner, framecounter, tracker->ended_line, tracker->lineduration,
+					tracker->lastlinestart, pixeltimes);
+			}
+			else if (tracker->ended_line >= 0) {
+				if (binner_stage) {
+					binner_stage->binLine(tracker->ended_line, tracker->lineduration, pixeltimes);
+				}
+				else {
+					binner.binLine(tracker->ended_line, tracker->lineduration, pixeltimes);
+				}
+			}
+			pixeltimes.clear();
+		}
+		if (time_series && tracker->framecounter != framecounter) {
+			// frame completed, count it if it went into the histogram
+			if (tracker->linesprocessed > frame_start_lines && ++frames_in_slice == frames_per_slice) {
+				write_slice();
+			}
+			frame_start_lines = tracker->linesprocessed;
+		}
+		return merged;
+	};
+	// records first_record ... first_record + numrecords - 1 are processed
+	auto process_records = [&](auto& processor, auto& buffer, uint64_t first_record, int64_t numrecords) {
+		pixeltimes.clear();
+		for (int64_t recnum = 0; recnum < numrecords; ++recnum) {
+			auto TTTRRecord = buffer.pop();
+			if (processor.isSpecial(TTTRRecord))
+			{
+				bool has_next = !buffer.noMoreData();
+				if (process_special(processor, TTTRRecord, first_record + recnum, has_next,
+					has_next ? buffer.peek() : 0)) {
+					buffer.pop();
+					++recnum;
+				}
+			}
+			else // photon detected
+			{
+				auto channel = processor.channel(TTTRRecord);
+				if (tracker->acceptsPhotons() &&
+					((channelofinterest < 0) || (channel == uint32_t(channelofinterest)))) {
+					assert(tracker->linecounter >= 0);
+					int64_t pixeltime = processor.truesync(TTTRRecord) - tracker->lastlinestart;
+					// store for later use:
+					pixeltimes.push_back({ processor.dtime(TTTRRecord), channel, pixeltime });
+				}
+			}
+			if (isterminal && (recnum & 0x7ffff) == 0) { // show progress indicator only in terminal sessions
+				log << 100 * recnum / numrecords << "% done\r" << std::flush; // NOTE: this has no significant effect on performance (tested)
+			}
+		}
+	};
+	// Same for mapped file, but records are classified block by block, so only
+	// the special records are visited one by one. Photons are taken in bulk.
+	auto& classes = buffers.classes;
+	auto process_mapped_records = [&](auto& processor, MappedRecordBuffer& buffer, uint64_t first_record, int64_t numrecords) {
+		auto classifier = RecordClassifier::forProcessor<std::decay_t<decltype(processor)>>(channelofinterest);
+		auto records = buffer.span();
+		size_t end = first_record + numrecords,
+			next = first_record; // first record not yet consumed
+		pixeltimes.clear();
+		for (size_t blockstart = first_record; blockstart < end; blockstart += RecordClassifier::BLOCKSIZE) {
+			size_t blockend = std::min(end, blockstart + RecordClassifier::BLOCKSIZE);
+			classifier.classify(records.data() + blockstart, blockend - blockstart, classes);
+			auto take_photons = [&](size_t upto) { // photons from next to upto-1
+				if (next < upto && tracker->acceptsPhotons()) {
+					assert(tracker->linecounter >= 0);
+					classes.forEachAccepted(next - blockstart, upto - blockstart, [&](size_t i) {
+						auto TTTRRecord = records[blockstart + i];
+						pixeltimes.push_back({ processor.dtime(TTTRRecord), processor.channel(TTTRRecord),
+							processor.truesync(TTTRRecord) - tracker->lastlinestart });
+						});
+				}
+			};
+			for (auto s : classes.special) {
+				size_t recpos = blockstart + s;
+				if (recpos < next) {
+					continue; // already merged with previous marker
+				}
+				take_photons(recpos);
+				bool has_next = recpos + 1 < records.size();
+				next = recpos + 1;
+				if (process_special(processor, records[recpos], recpos, has_next, has_next ? records[recpos + 1] : 0)) {
+					++next;
+				}
+			}
+			take_photons(blockend);
+			next = std::max(next, blockend);
+			buffer.seek(next);
+			if (isterminal && ((blockstart - first_record) & 0x7ffff) == 0) { // show progress indicator only in terminal sessions
+				log << 100 * (blockstart - first_record) / numrecords << "% done\r" << std::flush;
+			}
+		}
+	};
+	auto decode = [&](auto& processor, auto& buffer, uint64_t first_record, int64_t numrecords) {
+		if constexpr (std::is_same_v<std::decay_t<decltype(buffer)>, MappedRecordBuffer>) {
+			if (num_threads > 1 && !time_series && !event_mode) {
+				DecodeParallel(buffer.span().subspan(first_record, numrecords), processor, *tracker, binner,
+					channelofinterest, max_trig_diff, num_threads, build_index ? &index : nullptr);
+			}
+			else {
+				process_mapped_records(processor, buffer, first_record, numrecords);
+			}
+		}
+		else {
+			process_records(processor, buffer, first_record, numrecords);
+		}
+	};
+	// Until the frame trigger type is known, records are staged. Then processing
+	// starts over with the staged records, so the file is read only once.
+	// (A mapped file is simply rewound, this does not cost anything.)
+	auto analyze_and_process = [&](auto& processor, auto& buffer) {
+		// Records read while analyzing are staged, so they need not be read again. If the
+		// analysis takes longer (e.g. no frame trigger at all), staging is given up and
+		// the records are read again from the start.
+		constexpr size_t MAX_STAGED_RECORDS = size_t(1) << 20; // 4 MiB
+		TriggerAnalyzer analyzer(processor, fh, log);
+		std::vector<uint32_t> staged;
+		constexpr bool is_mapped = std::is_same_v<std::decay_t<decltype(buffer)>, MappedRecordBuffer>;
+		bool reread = is_mapped;
+		if (!ignore_frame_trigger) {
+			while (!analyzer.done() && !buffer.noMoreData()) {
+				auto record = buffer.pop();
+				if (!reread) {
+					if (staged.size() < MAX_STAGED_RECORDS) {
+						staged.push_back(record);
+					}
+					else {
+						std::vector<uint32_t>().swap(staged);
+						reread = true;
+					}
+				}
+				analyzer.feed(record);
+			}
+			analyzer.finish();
+			frame_trg_type = analyzer.frame_trg_type;
+			lines_to_skip = analyzer.lines_to_skip;
+		}
+		tracker.emplace(fh, frame_trg_type, lines_to_skip, frames);
+		if (build_index) {
+			index.key.frame_trg_type = frame_trg_type;
+			index.key.lines_to_skip = lines_to_skip;
+			index.addFrame(0, processor.overflowCorrection(), tracker->state());
+		}
+		if (reread) {
+			buffer.rewind();
+			decode(processor, buffer, 0, fh.num_records);
+		}
+		else {
+			PrefixedRecordBuffer<std::decay_t<decltype(buffer)>> replay_buffer(std::move(staged), buffer);
+			decode(processor, replay_buffer, 0, fh.num_records);
+		}
+		if (build_index) {
+			index.final = { uint64_t(fh.num_records), processor.overflowCorrection(), tracker->state() };
+		}
+	};
+	// Only the records of the selected frames are processed. The tracker is
+	// set to the state it would have at the start of each run of frames.
+	auto process_selected_frames = [&](auto& processor, auto& buffer) {
+		frame_trg_type = int(index.key.frame_trg_type);
+		lines_to_skip = index.key.lines_to_skip;
+		tracker.emplace(fh, frame_trg_type, lines_to_skip, frames);
+		int64_t linesprocessed = 0;
+		auto step = frames.step();
+		for (const auto& run : frames.runs()) {
+			// with a frame step, each selected frame is a run of its own
+			auto first = run.first + (step - (run.first - frames.first()) % step) % step;
+			while (first <= run.last && first < int64_t(index.frames.size())) {
+				auto last = step > 1 ? first : std::min(run.last, int64_t(index.frames.size()) - 1);
+				auto begin = index.beginRecord(first), end = index.endRecord(last);
+				const auto& entry = index.frames[first];
+				tracker->restore(entry.state);
+				tracker->linesprocessed = linesprocessed;
+				processor.setOverflowCorrection(entry.oflcorrection);
+				buffer.seek(begin);
+				decode(processor, buffer, begin, int64_t(end - begin));
+				linesprocessed = tracker->linesprocessed;
+				first = last + step;
+			}
+		}
+		// statistics as for the whole file
+		tracker->restore(index.final.state);
+		tracker->linesprocessed = linesprocessed;
+	};
+	// banded: the outfiles are written band by band, the BIN file simply grows,
+	// in the IBW file each band goes to its place in every time channel
+	std::vector<std::ofstream> band_files;
+	std::vector<std::streamoff> band_data_start;
+	// what the histograms leave of the memory limit, for re-ordering the bands of an IBW file
+	size_t band_histogram_bytes = plane_channels.size() * size_t(img_x * band_lines) * max_hist_channels * sizeof(uint16_t),
+		ibw_band_buffer_bytes = options.max_memory > band_histogram_bytes ? options.max_memory - band_histogram_bytes : 0;
+	auto write_band = [&](int64_t first_line) {
+		int64_t lines = std::min(band_lines, img_y - first_line);
+		for (size_t p = 0; p < planes.size(); ++p) {
+			// all lines went into maxDtime, so it is known after the first pass
+			auto export_channels = int64_t(binner.maxDtime[p]) + 1;
+			planes[p]->grow(size_t(export_channels));
+			if (first_line == 0) {
+				if (exporting_ibw && !IBWWaveFits(img_x * img_y * export_channels, sizeof(uint32_t))) {
+					throw std::runtime_error("histogram is too large for an IBW file (2 GiB max.), use BIN output instead");
+				}
+				band_files.emplace_back(outfilenames[p].c_str(), std::ios::out | std::ios::binary);
+				if (!band_files.back().good() || (exporting_ibw ?
+					WriteIBWHeader(band_files.back(), img_x, img_y, img_pixresol, img_resolution, export_channels, 0,
+						get_wavename(outfilenames[p]), fh.filedate) :
+					WriteBinHeader(band_files.back(), img_x, img_y, img_pixresol, img_resolution, export_channels)) != 0) {
+					throw std::runtime_error("error opening outfile");
+				}
+				band_data_start.push_back(band_files.back().tellp());
+			}
+			int res = exporting_ibw ?
+				WriteIBWBand(band_files[p], band_data_start[p], *planes[p], img_x, img_y, first_line, export_channels, num_threads,
+					ibw_band_buffer_bytes) :
+				WriteBinPixels(band_files[p], *planes[p], img_x, lines, export_channels, num_threads);
+			if (res != 0) {
+				throw std::runtime_error("error while writing lines " + std::to_string(first_line) + " - " +
+					std::to_string(first_line + lines - 1));
+			}
+		}
+	};
+	try {
+		for (int64_t band_first = 0; band_first < img_y; band_first += band_lines) {
+			if (band_first > 0) {
+				// next pass, over the same records
+				for (auto plane : planes) {
+					plane->reset(size_t(img_x * std::min(band_lines, img_y - band_first)), max_hist_channels, max_hist_channels);
+				}
+				if (pipelined_buffer) {
+					pipelined_buffer->seek(0);
+				}
+				else if (mapped_buffer) {
+					mapped_buffer->rewind();
+				}
+				else {
+					stream_buffer.rewind();
+				}
+				// the index built in the first pass lets us jump to the selected frames
+				have_index = have_index || build_index;
+				build_index = false;
+			}
+			if (banded) {
+				log << "lines " << band_first << " - " << std::min(img_y, band_first + band_lines) - 1 << std::endl;
+				binner.setBand(band_first, band_lines);
+			}
+			VisitRecordFormat(fh.record_type, [&](auto& processor) {
+				if constexpr (!std::decay_t<decltype(processor)>::isT2mode()) {
+					if (pipelined_buffer) {
+						if (have_index) {
+							process_selected_frames(processor, *pipelined_buffer);
+						}
+						else {
+							analyze_and_process(processor, *pipelined_buffer);
+						}
+					}
+					else if (mapped_buffer) {
+						if (have_index) {
+							process_selected_frames(processor, *mapped_buffer);
+						}
+						else {
+							analyze_and_process(processor, *mapped_buffer);
+						}
+					}
+					else {
+						if (have_index) {
+							process_selected_frames(processor, stream_buffer);
+						}
+						else {
+							analyze_and_process(processor, stream_buffer);
+						}
+					}
+				}
+				});
+			if (banded) {
+				if (binner_stage) {
+					binner_stage->sync();
+				}
+				binner.flush();
+				write_band(band_first);
+			}
+		}
+		if (binner_stage) {
+			binner_stage->finish();
+		}
+		if (time_series && tracker && tracker->linesprocessed > slice_start_lines) {
+			write_slice(); // incomplete slice at end of file
+		}
+	}
+	catch (std::exception& e) {
+		err << "ERROR: " << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	binner.flush();
+#ifdef DOPERFORMANCEANALYSIS
+	auto end_time = std::chrono::steady_clock::now();
+	std::chrono::duration<double> diff = end_time - start_time;
+	auto duration = diff.count();
+	log << "PERF-TEST: Time for execution: " << duration << " s (" << duration / fh.num_records
+		<< " s per record, " << fh.num_records / duration << " records/s)" << std::endl;
+	log << "PERF-TEST: page faults during execution: " << PageFaults() - start_faults << std::endl;
+	log << "PERF-TEST: record classification: " << SimdLevelName(BestSimdLevel()) << std::endl;
+	log << pixeltimes.capacity() << std::endl;
+#endif
+	pipelined_buffer.reset(); // stops reader
+	input.reset(); // close infile
+	if (save_index) {
+		if (index.save(MarkerIndexFileName(infilename))) {
+			log << "Frame index written to " << MarkerIndexFileName(infilename) << std::endl;
+		}
+		else {
+			log << "WARNING: could not write frame index " << MarkerIndexFileName(infilename) << std::endl;
+		}
+	}
+	auto framecounter = tracker->framecounter, totallines = tracker->totallines,
+		linesprocessed = tracker->linesprocessed, lineduration = tracker->lineduration;
+	const auto& maxDtime = time_series ? series_maxDtime : binner.maxDtime;
+	log << "first processed frame " << frames.first()
+		<< " \ntotal frames " << framecounter << " (processed: " << linesprocessed/fh.pix_y
+		<< ")\ntotal lines " << totallines << " (processed: " << linesprocessed
+		<< ")" << std::endl;
+
+	if (event_writer) {
+		log << "events: " << event_writer->numEvents() << "\nmax Dtime " << event_writer->maxDtime() << std::endl;
+		if (!event_writer->close()) {
+			err << "Error while writing events.\n";
+			return EXIT_FAILURE;
+		}
+	}
+	for (size_t p = 0; p < plane_channels.size() && !event_mode; ++p) {
+		if (plane_channels.size() > 1) {
+			log << (plane_channels[p] == SUM_OF_CHANNELS ? std::string("sum of channels") :
+				"channel " + std::to_string(plane_channels[p] + 1)) << ": ";
+		}
+		log << "max Dtime " << maxDtime[p] << std::endl;
+		if (phasor_mode) {
+			log << "phasor images: " << phasor_planes[p]->bytes() / 1024 << " KiB" << std::endl;
+			continue;
+		}
+		if (intensity_mode) {
+			log << "intensity images: " << meantime_planes[p]->bytes() / 1024 << " KiB" << std::endl;
+			continue;
+		}
+		if (gate_mode) {
+			log << "gate images: " << gate_planes[p]->bytes() / 1024 << " KiB" << std::endl;
+			continue;
+		}
+		log << "histogram: " << planes[p]->numChannels() << " time channels, " <<
+			planes[p]->bytes() / (1024 * 1024) << " MiB";
+		if (planes[p]->numSpilledPixels() > 0) {
+			log << " (" << planes[p]->numSpilledPixels() << " pixels with >65535 counts in a channel)";
+		}
+		log << std::endl;
+	}
+	assert(lineduration > 0);
+	double microsec_lastpixeltime = double(lineduration) * fh.GlobRes * 1.0e6 / double(fh.pix_x);
+	// round dwell time to nearest 0.1 micros:
+	log << "pixel dwell time " << std::round(microsec_lastpixeltime * 10.0) / 10.0 << " microseconds" << std::endl;
+	if (tracker->frametrgcount != framecounter) {
+		log << "WARNING: unexpected number of frame triggers in file (" << tracker->frametrgcount << ")" << std::endl;
+	}
+	if (totallines != ((fh.pix_y + lines_to_skip) * framecounter)) {
+		log << "WARNING: total lines in file do not match expected num. of lines" << std::endl;
+#ifndef NDEBUG
+		log << "Lines per processed frame: " << double(totallines) / double(framecounter) <<
+			"\nLines per frame trigger: " << double(totallines) / double(tracker->frametrgcount) << std::endl;
+#endif // !NDEBUG
+
+	}
+
+	if (event_mode) {
+		log << "\nEvents written." << std::endl;
+	}
+	else if (banded) {
+		log << "\nOutfile written band by band." << std::endl;
+	}
+	else if (exporting_ibw) {
+		log << "\nExporting Igor binary wave." << std::endl;
+	}
+	else {
+		log << "\nExporting bin file." << std::endl;
+	}
+
+#ifdef DOPERFORMANCEANALYSIS
+	auto export_start_time = std::chrono::steady_clock::now();
+#endif
+	if (time_series) {
+		// the slices have been written already
+		log << num_slices << " slice(s) written." << std::endl;
+		for (size_t p = 0; p < stacks.size(); ++p) {
+			stacks[p].seekp(0);
+			if (WriteIBWHeader(stacks[p], img_x, img_y, img_pixresol, img_resolution,
+				num_useful_histo_ch, num_slices, wavenames[p], fh.filedate) != 0) {
+				err << "Error while writing outfile.\n";
+				return EXIT_FAILURE;
+			}
+			stacks[p].close();
+		}
+	}
+	else if (phasor_mode || intensity_mode || gate_mode) {
+		auto write_image = [&](const std::string& name, const auto* data) {
+			log << "Writing outfile " << name << std::endl;
+			std::ofstream outfile(name.c_str(), std::ios::out | std::ios::binary);
+			int res = !outfile.good() || (exporting_ibw ?
+				ExportIBWImage(outfile, data, img_x, img_y, img_pixresol, get_wavename(name), fh.filedate) :
+				ExportBinImage(outfile, data, img_x, img_y, img_pixresol, img_resolution)) != 0;
+			outfile.close();
+			return res;
+		};
+		for (size_t p = 0; p < plane_channels.size(); ++p) {
+			int res = 0;
+			if (phasor_mode) {
+				// intensity, then G and S of each harmonic
+				const auto& phasor = *phasor_planes[p];
+				res = write_image(InsertBeforeExtension(outfilenames[p], "_int"), phasor.intensity().data());
+				for (size_t h = 0; h < harmonics.size() && res == 0; ++h) {
+					auto number = std::to_string(harmonics[h]);
+					res = write_image(InsertBeforeExtension(outfilenames[p], "_g" + number), phasor.image(h, false).data()) ||
+						write_image(InsertBeforeExtension(outfilenames[p], "_s" + number), phasor.image(h, true).data());
+				}
+			}
+			else if (gate_mode) {
+				const auto& gateimage = *gate_planes[p];
+				for (size_t g = 0; g < gateimage.numGates() && res == 0; ++g) {
+					res = write_image(InsertBeforeExtension(outfilenames[p], "_gate" + std::to_string(g + 1)), gateimage.image(g));
+				}
+			}
+			else {
+				// intensity and mean arrival time in ns
+				const auto& meantime = *meantime_planes[p];
+				res = write_image(InsertBeforeExtension(outfilenames[p], "_int"), meantime.intensity().data()) ||
+					write_image(InsertBeforeExtension(outfilenames[p], "_mean"), meantime.meanTime(img_resolution * 1e9).data());
+			}
+			if (res != 0) {
+				err << "Error while writing outfile.\n";
+				return EXIT_FAILURE;
+			}
+		}
+	}
+	for (auto& f : band_files) {
+		f.close();
+		if (!f) {
+			err << "Error while writing outfile.\n";
+			return EXIT_FAILURE;
+		}
+	}
+	for (size_t p = 0; p < planes.size() && !time_series && !banded; ++p) {
+		const auto& name = outfilenames[p];
+		auto export_channels = int64_t(maxDtime[p]) + 1; // need to store one datapoint more than max Dtime
+		if (exporting_ibw && !IBWWaveFits(img_x * img_y * export_channels, sizeof(uint32_t))) {
+			err << "ERROR: histogram is too large for an IBW file (2 GiB max.), use BIN output instead" << std::endl;
+			return EXIT_FAILURE;
+		}
+		if (planes.size() > 1) {
+			log << "Writing outfile " << name << std::endl;
+		}
+		else {
+			log << "Writing outfile." << std::endl;
+		}
+		std::ofstream outfile(name.c_str(), std::ios::out | std::ios::binary);
+		if (!outfile.good()) {
+			err << " error opening outfile\n";
+			return EXIT_FAILURE;
+		}
+		int res = 0;
+		if (!exporting_ibw) {
+			res = export_bin(outfile, *planes[p], export_channels);
+		}
+		else {
+			res = ExportIBWFile(outfile, *planes[p], img_x, img_y, img_pixresol, img_resolution,
+				export_channels, get_wavename(name), fh.filedate, num_threads);
+		}
+		if (res != 0) {
+			outfile.close();
+			err << "Error while writing outfile.\n";
+			return EXIT_FAILURE;
+		}
+		outfile.close();
+	}
+#ifdef DOPERFORMANCEANALYSIS
+	std::chrono::duration<double> export_diff = std::chrono::steady_clock::now() - export_start_time;
+	log << "PERF-TEST: Time for export: " << export_diff.count() << " s" << std::endl;
+#endif
+
+	log << "Done." << std::endl;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,167 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+//
+// Conversion of a single PTU file, used for single files as well as in batch mode.
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <ostream>
+#include <mutex>
+#include <condition_variable>
+#include "LineFrameTracker.h"
+#include "CompactHistogram.h"
+#include "HistogramBinner.h"
+#include "PhasorImage.h"
+#include "MeanTimeImage.h"
+#include "GateImages.h"
+#include "RecordClassifier.h"
+
+struct ConversionOptions {
+	int channelofinterest = 1; // < 0: all channels
+	// if not empty: one histogram plane (and outfile) per channel, instead of channelofinterest
+	// (SUM_OF_CHANNELS: all channels)
+	std::vector<int> channels;
+	int64_t lines_to_skip = 0;
+	FrameSelection frames;
+	bool ignore_frame_trigger{ false }, use_mmap{ true }, use_index{ false },
+		show_progress{ false };
+	unsigned int num_threads = 1;
+	// read, decode and bin on separate threads (instead of mapping the file)
+	bool pipeline{ false };
+	// > 0: time series, the frames are not summed up, instead every frames_per_slice
+	// processed frames are written as one slice (BIN: one file each, IBW: 4D wave)
+	int64_t frames_per_slice = 0;
+	// not empty: phasor mode, intensity and G/S images of these harmonics instead of histogram
+	std::vector<int> phasor_harmonics;
+	bool intensity_mode{ false }; // intensity and mean arrival time images instead of histogram
+	// bin_xy x bin_xy pixels and bin_t Dtime channels are binned into one while accumulating
+	int64_t bin_xy = 1, bin_t = 1;
+	// not empty: gate mode, one intensity image per Dtime gate instead of histogram
+	std::vector<DtimeGate> gates;
+	// event mode: photons are written as events (see EventWriter.h) instead of a histogram,
+	// all frames and channels unless event_filter is set
+	bool event_mode{ false }, event_macrotime{ false }, event_filter{ false };
+	// > 0: bytes available for the histogram, a larger histogram is made in bands
+	// of lines, with one pass over the file per band
+	size_t max_memory = 0;
+	// back the histogram with transparent huge pages (Linux), fewer page faults for dense histograms
+	bool huge_pages{ false };
+};
+
+// buffers that can be reused from one conversion to the next
+struct ConversionBuffers {
+	std::vector<std::unique_ptr<CompactHistogram>> histograms; // one per plane
+	std::vector<std::unique_ptr<PhasorImage>> phasors; // one per plane, phasor mode
+	std::vector<std::unique_ptr<MeanTimeImage>> meantimes; // one per plane, intensity mode
+	std::vector<std::unique_ptr<GateImages>> gateimages; // one per plane, gate mode
+	std::vector<PixelTime> pixeltimes;
+	RecordBlockClasses classes;
+};
+
+// Limits the memory used by conversions running in parallel.
+class MemoryBudget
+{
+	std::mutex mutex;
+	std::condition_variable cv;
+	size_t limit, used;
+public:
+	explicit MemoryBudget(size_t Limit) : limit{ Limit }, used{ 0 } {};
+	// Blocks until bytes are available. A request larger than the limit
+	// is granted when nothing else is reserved.
+	void acquire(size_t bytes)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cv.wait(lock, [&] { return used == 0 || used + bytes <= limit; });
+		used += bytes;
+	};
+	void release(size_t bytes)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			used -= bytes;
+		}
+		cv.notify_all();
+	};
+
+	class Reservation
+	{
+		MemoryBudget& budget;
+		size_t bytes;
+	public:
+		Reservation(MemoryBudget& Budget, size_t Bytes) : budget{ Budget }, bytes{ Bytes } { budget.acquire(bytes); };
+		~Reservation() { budget.release(bytes); };
+		Reservation(const Reservation&) = delete;
+		Reservation& operator=(const Reservation&) = delete;
+	};
+};
+
+// channels that are histogrammed, one plane each
+inline std::vector<int> PlaneChannels(const ConversionOptions& options)
+{
+	if (options.event_mode && !options.event_filter) {
+		return { SUM_OF_CHANNELS };
+	}
+	if (options.channels.empty()) {
+		return { options.channelofinterest < 0 ? SUM_OF_CHANNELS : options.channelofinterest };
+	}
+	return options.channels;
+}
+
+// image.bin -> image<suffix>.bin
+inline std::string InsertBeforeExtension(const std::string& filename, const std::string& suffix)
+{
+	auto poslastdot = filename.find_last_of('.'), lastslash = filename.find_last_of("/\\");
+	if (poslastdot == std::string::npos || (lastslash != std::string::npos && poslastdot < lastslash)) {
+		poslastdot = filename.size();
+	}
+	return filename.substr(0, poslastdot) + suffix + filename.substr(poslastdot);
+}
+
+// With several planes, the outfile name of each plane gets the channel
+// appended, e.g. image.bin -> image_ch1.bin, image_sum.bin
+inline std::vector<std::string> OutFileNames(const std::string& outfilename, const std::vector<int>& plane_channels)
+{
+	if (plane_channels.size() == 1) {
+		return { outfilename };
+	}
+	std::vector<std::string> names;
+	for (auto ch : plane_channels) {
+		names.push_back(InsertBeforeExtension(outfilename,
+			ch == SUM_OF_CHANNELS ? "_sum" : "_ch" + std::to_string(ch + 1)));
+	}
+	return names;
+}
+
+// event mode: base name of the column files, e.g. run.evt -> run (-> run_x.u16 etc.)
+inline std::string EventBaseName(const std::string& outfilename)
+{
+	auto poslastdot = outfilename.find_last_of('.'), lastslash = outfilename.find_last_of("/\\");
+	if (poslastdot == std::string::npos || (lastslash != std::string::npos && poslastdot < lastslash)) {
+		return outfilename;
+	}
+	return outfilename.substr(0, poslastdot);
+}
+
+// BIN time series: file of slice #, e.g. image.bin -> image_0003.bin
+inline std::string SliceFileName(const std::string& outfilename, int64_t slice)
+{
+	auto number = std::to_string(slice);
+	return InsertBeforeExtension(outfilename, "_" + std::string(number.size() < 4 ? 4 - number.size() : 0, '0') + number);
+}
+
+// Converts infile to outfile (BIN or IBW, depending on extension; several
+// planes: see OutFileNames), the report
+// goes to log, error messages to err. If a budget is given, the memory needed
+// for the histogram is reserved while the file is converted.
+// Returns EXIT_SUCCESS or EXIT_FAILURE.
+int ConvertFile(const std::string& infilename, const std::string& outfilename,
+	const ConversionOptions& options, ConversionBuffers& buffers,
+	std::ostream& log, std::ostream& err, MemoryBudget* budget = nullptr);
+
+// Converts a sparse BIN file (see SparseBin.h) to outfile (BIN or IBW, depending on extension).
+// Returns EXIT_SUCCESS or EXIT_FAILURE, messages go to log and err.
+int ExpandSparseBinFile(const std::string& infilename, const std::string& outfilename,
+	std::ostream& log, std::ostream& err);
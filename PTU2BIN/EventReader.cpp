@@ -0,0 +1,210 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include "EventReader.h"
+#include "TTTRRecordProcessor.h"
+#include "RecordBuffer.h"
+#include "MappedRecordBuffer.h"
+#include "CompressedInput.h"
+#include "TriggerAnalyzer.h"
+#include "HistogramBinner.h"
+
+struct EventReader::Impl
+{
+	std::unique_ptr<std::istream> input; // only if records are read from a stream
+	virtual ~Impl() = default;
+	virtual size_t read(std::span<ScanEvent> buffer) = 0;
+	virtual bool atEnd() const = 0;
+};
+
+namespace {
+	// decodes the records line by line, the events of a line are staged
+	// until the caller picks them up
+	template<class Processor, class Buffer> class EventDecoder : public EventReader::Impl
+	{
+		Processor processor;
+		std::unique_ptr<Buffer> records;
+		FrameSelection frames;
+		LineFrameTracker tracker;
+		HistogramBinner mapper;
+		int channelofinterest, max_trig_diff;
+		std::vector<PixelTime> pixeltimes; // photons of current line
+		std::vector<ScanEvent> ready;
+		size_t ready_pos;
+
+		void processSpecial(uint32_t TTTRRecord)
+		{
+			if (processor.processOverflow(TTTRRecord)) {
+				return;
+			}
+			auto trigger = processor.markers(TTTRRecord);
+			if (!records->noMoreData()) {
+				auto next_record = records->peek();
+				if (processor.isMarker(next_record) &&
+					(processor.nsync(next_record) - processor.nsync(TTTRRecord) <= max_trig_diff)) {
+					trigger |= processor.markers(next_record); // merge marker events
+					records->pop();
+				}
+			}
+			auto framecounter = tracker.framecounter;
+			auto events = tracker.processMarker(trigger, processor.truesync(TTTRRecord));
+			if (events & LineFrameTracker::LINE_ENDED) {
+				if (tracker.ended_line >= 0) {
+					auto frame = uint32_t(framecounter);
+					auto line = uint16_t(tracker.ended_line);
+					mapper.forEachPhotonX(tracker.ended_line, tracker.lineduration, pixeltimes,
+						[&](const PixelTime& pt, uint64_t, int64_t x) {
+							ready.push_back({ tracker.lastlinestart + pt.pixeltime, frame, uint16_t(x), line,
+								uint16_t(pt.dtime), uint8_t(pt.channel), ScanEvent::PHOTON });
+						});
+					ready.push_back({ tracker.lastlinestop, frame, 0, line, 0, 0, ScanEvent::LINE_END });
+				}
+				pixeltimes.clear();
+			}
+			if (tracker.framecounter != framecounter && frames.contains(framecounter)) {
+				ready.push_back({ tracker.lastlinestop, uint32_t(framecounter), 0, 0, 0, 0, ScanEvent::FRAME_END });
+			}
+		};
+		// decodes until events are ready, returns false if there are no more records
+		bool decode()
+		{
+			while (ready.empty()) {
+				if (records->noMoreData()) {
+					return false;
+				}
+				auto TTTRRecord = records->pop();
+				if (processor.isSpecial(TTTRRecord)) {
+					processSpecial(TTTRRecord);
+				}
+				else if (tracker.acceptsPhotons()) {
+					auto channel = processor.channel(TTTRRecord);
+					if (channelofinterest < 0 || channel == uint32_t(channelofinterest)) {
+						pixeltimes.push_back({ processor.dtime(TTTRRecord), channel,
+							processor.truesync(TTTRRecord) - tracker.lastlinestart });
+					}
+				}
+			}
+			return true;
+		};
+	public:
+		EventDecoder(const Processor& Processor_, std::unique_ptr<Buffer> Records, const PTUFileHeader& fh,
+			int Channelofinterest, const FrameSelection& Frames, int frame_trg_type, int64_t lines_to_skip) :
+			processor{ Processor_ }, records{ std::move(Records) }, frames{ Frames },
+			tracker(fh, frame_trg_type, lines_to_skip, Frames),
+			mapper{ HistogramBinner::EventMapper({ Channelofinterest < 0 ? SUM_OF_CHANNELS : Channelofinterest }, fh) },
+			channelofinterest{ Channelofinterest }, max_trig_diff{ 0 }, ready_pos{ 0 }
+		{
+			constexpr double MAX_TRIGGER_DIFF_SEC = 120e-6;
+			if (fh.GlobRes > 1e-9) {
+				max_trig_diff = int(MAX_TRIGGER_DIFF_SEC / fh.GlobRes);
+			}
+		};
+		size_t read(std::span<ScanEvent> buffer) override
+		{
+			size_t n = 0;
+			while (n < buffer.size()) {
+				if (ready_pos == ready.size()) {
+					ready.clear(); // keeps capacity, so this allocates only while lines grow
+					ready_pos = 0;
+					if (!decode()) {
+						break;
+					}
+				}
+				auto count = std::min(buffer.size() - n, ready.size() - ready_pos);
+				std::copy_n(ready.begin() + ready_pos, count, buffer.begin() + n);
+				n += count;
+				ready_pos += count;
+			}
+			return n;
+		};
+		bool atEnd() const override
+		{
+			return ready_pos == ready.size() && records->noMoreData();
+		};
+	};
+
+	// Detects the frame trigger type, then rewinds the records and
+	// creates the decoder for them.
+	template<class Processor, class Buffer> std::unique_ptr<EventReader::Impl> MakeDecoder(
+		Processor& processor, std::unique_ptr<Buffer> records, const PTUFileHeader& fh, int channel,
+		const FrameSelection& frames)
+	{
+		std::ostringstream log;
+		TriggerAnalyzer analyzer(processor, fh, log);
+		while (!analyzer.done() && !records->noMoreData()) {
+			analyzer.feed(records->pop());
+		}
+		analyzer.finish();
+		records->rewind();
+		return std::make_unique<EventDecoder<Processor, Buffer>>(processor, std::move(records), fh, channel,
+			frames, analyzer.frame_trg_type, analyzer.lines_to_skip);
+	}
+}
+
+EventReader::EventReader(const std::string& filename, int channel, const FrameSelection& frames)
+{
+	bool compressed = IsGzipFile(filename);
+	auto input = OpenInFile(filename, compressed);
+	std::ostringstream log, err;
+	if (!input->good()) {
+		throw std::runtime_error("cannot open " + filename);
+	}
+	if (!fh.ProcessFile(*input, log, err) || !input->good()) {
+		throw std::runtime_error("error processing file headers: " + err.str());
+	}
+	if (fh.measurement_submode != 3 || (fh.dimensions != 3 && fh.dimensions != -1)) {
+		throw std::runtime_error("not an image scan");
+	}
+	if (!fh.allNeededPresent()) {
+		throw std::runtime_error("some data missing from PTU file header");
+	}
+	auto record_format = GetRecordFormat(fh.record_type);
+	if (record_format == RecordFormat::unknown || IsT2Format(record_format) || fh.measurement_mode != 3) {
+		throw std::runtime_error("unsupported record type (T3 needed)");
+	}
+	size_t records_offset = size_t(input->tellg());
+	VisitRecordFormat(fh.record_type, [&](auto& processor) {
+		if constexpr (!std::decay_t<decltype(processor)>::isT2mode()) {
+			std::unique_ptr<MappedRecordBuffer> mapped;
+			if (!compressed) {
+				try {
+					mapped = std::make_unique<MappedRecordBuffer>(filename, records_offset, fh.num_records);
+				}
+				catch (const std::exception&) {
+					// use buffered reading
+				}
+			}
+			if (mapped) {
+				impl = MakeDecoder(processor, std::move(mapped), fh, channel, frames);
+			}
+			else {
+				auto records = std::make_unique<RecordBuffer>(*input, fh.num_records);
+				impl = MakeDecoder(processor, std::move(records), fh, channel, frames);
+				impl->input = std::move(input);
+			}
+		}
+		});
+}
+
+EventReader::~EventReader() = default;
+EventReader::EventReader(EventReader&&) noexcept = default;
+EventReader& EventReader::operator=(EventReader&&) noexcept = default;
+
+size_t EventReader::read(std::span<ScanEvent> buffer)
+{
+	try {
+		return impl->read(buffer);
+	}
+	catch (const std::range_error&) {
+		throw std::runtime_error("unexpected end of records");
+	}
+}
+
+bool EventReader::atEnd() const
+{
+	return impl->atEnd();
+}
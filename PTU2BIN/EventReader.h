@@ -0,0 +1,99 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+//
+// Reading the photons of a PTU image file as a stream of events (part of libptu).
+// The caller owns the event buffer, EventReader fills it again and again,
+// so no memory is allocated per event:
+//
+//   EventReader reader("scan.ptu");
+//   std::vector<ScanEvent> buffer(1 << 16);
+//   for (const auto& ev : reader.events(buffer)) { ... }
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <string>
+#include "PTUFileHeader.h"
+#include "LineFrameTracker.h"
+
+struct ScanEvent {
+	enum Type : uint8_t {
+		PHOTON = 0,
+		LINE_END = 1, // after the photons of line y
+		FRAME_END = 2 // after the last line of a frame
+	};
+	// overflow corrected, in sync periods; photon: arrival, line and frame end: line stop
+	int64_t macrotime;
+	uint32_t frame;
+	uint16_t x, y; // pixel (x only for photons)
+	uint16_t dtime; // photons only
+	uint8_t channel; // photons only, 0 based
+	uint8_t type;
+};
+static_assert(sizeof(ScanEvent) == 24, "unexpected padding");
+
+class EventReader
+{
+public:
+	struct Impl;
+private:
+	PTUFileHeader fh;
+	std::unique_ptr<Impl> impl;
+public:
+	// channel is 0 based, < 0: all channels; photons of frames not selected are skipped.
+	// Throws std::runtime_error if the file cannot be read or is not a T3 image.
+	explicit EventReader(const std::string& filename, int channel = -1,
+		const FrameSelection& frames = FrameSelection());
+	~EventReader();
+	EventReader(EventReader&&) noexcept;
+	EventReader& operator=(EventReader&&) noexcept;
+
+	const PTUFileHeader& header() const { return fh; };
+	int64_t width() const { return fh.pix_x; };
+	int64_t height() const { return fh.pix_y; };
+
+	// fills buffer with the next events, returns the number of events (0: no more events);
+	// throws std::runtime_error if the records cannot be read
+	size_t read(std::span<ScanEvent> buffer);
+	bool atEnd() const;
+
+	// input range over the remaining events, refilling buffer as needed
+	class EventRange
+	{
+		EventReader* reader;
+		std::span<ScanEvent> buffer;
+	public:
+		class iterator
+		{
+			EventReader* reader{ nullptr };
+			std::span<ScanEvent> buffer;
+			size_t pos{ 0 }, count{ 0 };
+		public:
+			using iterator_concept = std::input_iterator_tag;
+			using value_type = ScanEvent;
+			using difference_type = std::ptrdiff_t;
+			iterator() = default;
+			iterator(EventReader* Reader, std::span<ScanEvent> Buffer) : reader{ Reader }, buffer{ Buffer },
+				count{ Reader->read(Buffer) } {};
+			const ScanEvent& operator*() const { return buffer[pos]; };
+			const ScanEvent* operator->() const { return &buffer[pos]; };
+			iterator& operator++()
+			{
+				if (++pos == count) {
+					pos = 0;
+					count = reader->read(buffer);
+				}
+				return *this;
+			};
+			void operator++(int) { ++*this; };
+			bool operator==(std::default_sentinel_t) const { return pos >= count; };
+		};
+		EventRange(EventReader* Reader, std::span<ScanEvent> Buffer) : reader{ Reader }, buffer{ Buffer } {};
+		iterator begin() { return iterator(reader, buffer); };
+		std::default_sentinel_t end() const { return {}; };
+	};
+	EventRange events(std::span<ScanEvent> buffer) { return EventRange(this, buffer); };
+};
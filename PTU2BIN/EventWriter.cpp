@@ -0,0 +1,63 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+
+#include <algorithm>
+#include "EventWriter.h"
+
+namespace {
+	constexpr const char* COLUMN_SUFFIXES[] = { "_frame.u32", "_y.u16", "_x.u16", "_dtime.u16", "_channel.u8",
+		"_macrotime.i64" };
+}
+
+std::vector<std::string> EventWriter::FileNames(const std::string& basename, bool with_macrotime)
+{
+	std::vector<std::string> names;
+	for (size_t c = 0; c < std::size(COLUMN_SUFFIXES) - (with_macrotime ? 0 : 1); ++c) {
+		names.push_back(basename + COLUMN_SUFFIXES[c]);
+	}
+	return names;
+}
+
+EventWriter::EventWriter(const std::string& basename, bool With_macrotime) : with_macrotime{ With_macrotime },
+	num_events{ 0 }, max_dtime{ 0 }
+{
+	for (const auto& name : FileNames(basename, with_macrotime)) {
+		files.emplace_back(name.c_str(), std::ios::out | std::ios::binary);
+	}
+	frames.reserve(CHUNK_EVENTS);
+	ys.reserve(CHUNK_EVENTS);
+	xs.reserve(CHUNK_EVENTS);
+	dtimes.reserve(CHUNK_EVENTS);
+	channels.reserve(CHUNK_EVENTS);
+	if (with_macrotime) {
+		macrotimes.reserve(CHUNK_EVENTS);
+	}
+}
+
+bool EventWriter::good() const
+{
+	return std::all_of(files.begin(), files.end(), [](const std::ofstream& f) { return f.good(); });
+}
+
+bool EventWriter::flush()
+{
+	num_events += frames.size();
+	writeColumn(0, frames);
+	writeColumn(1, ys);
+	writeColumn(2, xs);
+	writeColumn(3, dtimes);
+	writeColumn(4, channels);
+	if (with_macrotime) {
+		writeColumn(5, macrotimes);
+	}
+	return good();
+}
+
+bool EventWriter::close()
+{
+	bool ok = flush();
+	for (auto& f : files) {
+		f.close();
+	}
+	return ok;
+}
@@ -0,0 +1,66 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+//
+// Writes the photons of the processed lines as events, one file per column
+// (raw little endian arrays, so they can be memory mapped):
+//   <base>_frame.u32, <base>_y.u16, <base>_x.u16, <base>_dtime.u16, <base>_channel.u8
+//   and optionally <base>_macrotime.i64 (absolute, overflow corrected, in sync periods)
+// Events are staged column by column and written in large chunks.
+
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "HistogramBinner.h"
+
+class EventWriter
+{
+	static constexpr size_t CHUNK_EVENTS = size_t(1) << 20;
+	bool with_macrotime;
+	std::vector<std::ofstream> files; // in column order
+	std::vector<uint32_t> frames;
+	std::vector<uint16_t> ys, xs, dtimes;
+	std::vector<uint8_t> channels;
+	std::vector<int64_t> macrotimes;
+	uint64_t num_events;
+	uint32_t max_dtime;
+
+	template<class T> void writeColumn(size_t c, std::vector<T>& column)
+	{
+		files[c].write((const char*)column.data(), sizeof(T) * column.size());
+		column.clear();
+	};
+public:
+	EventWriter(const std::string& basename, bool With_macrotime);
+
+	// names of column files
+	static std::vector<std::string> FileNames(const std::string& basename, bool with_macrotime);
+
+	// adds the photons of a line (binner maps them to columns and applies the channel filter)
+	void addLine(HistogramBinner& binner, int64_t frame, int64_t line, int64_t lineduration,
+		int64_t linestart, const std::vector<PixelTime>& pixeltimes)
+	{
+		binner.forEachPhotonX(line, lineduration, pixeltimes, [&](const PixelTime& pt, uint64_t, int64_t x) {
+			frames.push_back(uint32_t(frame));
+			ys.push_back(uint16_t(line));
+			xs.push_back(uint16_t(x));
+			dtimes.push_back(uint16_t(pt.dtime));
+			channels.push_back(uint8_t(pt.channel));
+			if (with_macrotime) {
+				macrotimes.push_back(linestart + pt.pixeltime);
+			}
+			max_dtime = std::max(max_dtime, uint32_t(pt.dtime));
+			});
+		if (frames.size() >= CHUNK_EVENTS) {
+			flush();
+		}
+	};
+	// writes staged events, returns false on error
+	bool flush();
+	// flushes and closes files, returns false on error
+	bool close();
+	uint64_t numEvents() const { return num_events + frames.size(); };
+	uint32_t maxDtime() const { return max_dtime; };
+	bool good() const;
+};
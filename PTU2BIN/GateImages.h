@@ -0,0 +1,82 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+//
+// Time-gated intensity images: one image per gate, counting the photons
+// with a Dtime inside the gate. A table tells which gates a Dtime falls into
+// (gates may overlap).
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <bit>
+
+// gate from start (inclusive) to end (exclusive), in ns
+struct DtimeGate {
+	double start, end;
+};
+
+class GateImages
+{
+	size_t numpixels, numgates;
+	std::vector<uint32_t> gates_of_dtime; // bit g set: Dtime is in gate g
+	std::vector<uint32_t> counts; // numgates * numpixels, image by image
+public:
+	static constexpr size_t MAX_GATES = 32;
+
+	GateImages() : numpixels{ 0 }, numgates{ 0 } {};
+	GateImages(const GateImages&) = delete;
+	GateImages& operator=(const GateImages&) = delete;
+
+	// first Dtime in gate
+	static uint32_t firstDtime(const DtimeGate& gate, double resolution_ns)
+	{
+		return uint32_t(std::max(0.0, std::ceil(gate.start / resolution_ns)));
+	};
+	// first Dtime after gate
+	static uint32_t endDtime(const DtimeGate& gate, double resolution_ns)
+	{
+		return uint32_t(std::max(0.0, std::ceil(gate.end / resolution_ns)));
+	};
+
+	// clear and set up for new image, Dtime 0 ... Channels-1 are used
+	void reset(size_t Numpixels, size_t Channels, const std::vector<DtimeGate>& gates, double resolution_ns)
+	{
+		numpixels = Numpixels;
+		numgates = std::min(gates.size(), MAX_GATES);
+		gates_of_dtime.assign(Channels, 0);
+		for (size_t g = 0; g < numgates; ++g) {
+			auto end = std::min<size_t>(endDtime(gates[g], resolution_ns), Channels);
+			for (size_t dt = firstDtime(gates[g], resolution_ns); dt < end; ++dt) {
+				gates_of_dtime[dt] |= uint32_t(1) << g;
+			}
+		}
+		counts.assign(numgates * numpixels, 0);
+	};
+
+	size_t numGates() const { return numgates; };
+	size_t bytes() const { return counts.size() * sizeof(uint32_t); };
+
+	// count photon in its gates, returns false if it is not in any gate.
+	// May be called concurrently for different pixels.
+	bool add(size_t pixel, uint32_t dt)
+	{
+		if (dt >= gates_of_dtime.size()) {
+			return false;
+		}
+		uint32_t gates = gates_of_dtime[dt];
+		if (gates == 0) {
+			return false;
+		}
+		do {
+			++counts[size_t(std::countr_zero(gates)) * numpixels + pixel];
+			gates &= gates - 1;
+		} while (gates);
+		return true;
+	};
+
+	// image of gate # g
+	const uint32_t* image(size_t g) const { return counts.data() + g * numpixels; };
+};
@@ -0,0 +1,332 @@
+// (c) 2021 - 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+//
+// Sorts the photons of a completed line into the histogram.
+
+#pragma once
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <bit>
+#include <limits>
+#include "PTUFileHeader.h"
+#include "CompactHistogram.h"
+#include "PhasorImage.h"
+#include "MeanTimeImage.h"
+#include "GateImages.h"
+
+// place for temporary storage of line data
+struct PixelTime {
+	unsigned int dtime;
+	uint32_t channel;
+	int64_t pixeltime;
+};
+
+// photon that did not fit the time axis of the histogram (yet)
+struct PendingPhoton {
+	size_t pixel;
+	uint32_t dtime, plane;
+};
+
+// channel of a histogram plane that sums up all channels
+constexpr int SUM_OF_CHANNELS = -1;
+
+// Pixel boundaries of a line with sinusoidal correction, for one lineduration.
+// Built from the exact mapping, so looking up x gives the same result as calculating it.
+struct SinPixelTable {
+	int64_t lineduration{ -1 };
+	std::vector<int64_t> boundary; // boundary[k]: smallest pixeltime that maps to x > k
+	std::vector<uint32_t> bucket_x; // x of pixeltime (j << shift)
+	int shift{};
+};
+
+// Photons are binned into one or more histogram planes, each plane collects
+// one detector channel or the sum of all channels. In phasor, intensity or gate
+// mode, the planes are phasor, mean arrival time or gated images instead of histograms.
+// Copies of a HistogramBinner share the histograms, but keep their own maxDtime
+// and pending photons. Several copies may be used concurrently as long as they
+// work on different lines and defer growing the time axis (see deferGrowth()).
+class HistogramBinner
+{
+	std::vector<CompactHistogram*> histograms;
+	std::vector<PhasorImage*> phasors;
+	std::vector<MeanTimeImage*> meantimes;
+	std::vector<GateImages*> gateimages;
+	std::array<uint64_t, 64> planes_of_channel; // bit p set: photon goes into plane p
+	int64_t pix_x, sin_correction;
+	int64_t bin_xy, bin_t, image_pix_x; // binning, image_pix_x: width of binned image
+	int64_t band_first, band_lines; // image lines that go into the planes (see setBand())
+	double sin_corr_scale;
+	bool is_bidirect, use_sin_table;
+	bool defer_growth{ false }; // photons beyond the time axis wait in pending
+	// lineduration usually jitters between a few values, so we keep some tables
+	static constexpr size_t SIN_TABLE_CACHE_SIZE = 8;
+	std::vector<SinPixelTable> sin_tables;
+	size_t next_sin_table;
+
+	// x for pixeltime with sinusoidal correction (unclamped)
+	int64_t sinPixel(int64_t pixeltime, int64_t lineduration) const
+	{
+		// apply sinusoidal correction
+		// I hope this is correct, since info from on this is scarce
+		double t_n = 2.0 * pixeltime / lineduration - 1.0;
+		double phi = t_n * M_PI * sin_correction / 200.0;
+		return int64_t((std::sin(phi) / sin_corr_scale + 1.0) * pix_x / 2.0);
+	};
+	int64_t clampedSinPixel(int64_t pixeltime, int64_t lineduration) const
+	{
+		return std::max(int64_t(0), std::min(sinPixel(pixeltime, lineduration), pix_x - 1));
+	};
+	// The mapping is monotonic for 0 <= pixeltime <= lineduration (if 0 < sin_correction <= 100),
+	// the boundaries are estimated by the inverse mapping and then adjusted to the exact mapping.
+	const SinPixelTable& sinTable(int64_t lineduration)
+	{
+		for (const auto& tab : sin_tables) {
+			if (tab.lineduration == lineduration) {
+				return tab;
+			}
+		}
+		if (sin_tables.size() < SIN_TABLE_CACHE_SIZE) {
+			sin_tables.emplace_back();
+			next_sin_table = sin_tables.size() - 1;
+		}
+		auto& tab = sin_tables[next_sin_table];
+		next_sin_table = (next_sin_table + 1) % SIN_TABLE_CACHE_SIZE;
+		tab.lineduration = lineduration;
+		tab.boundary.resize(size_t(pix_x - 1));
+		double phi_max = M_PI * sin_correction / 200.0;
+		int64_t pt = 0;
+		for (int64_t k = 0; k < pix_x - 1; ++k) {
+			double s = std::clamp(2.0 * double(k + 1) / double(pix_x) - 1.0, -1.0, 1.0) * sin_corr_scale;
+			int64_t estimate = int64_t((std::asin(s) / phi_max + 1.0) * double(lineduration) / 2.0);
+			pt = std::clamp(estimate, pt, lineduration + 1);
+			while (pt > 0 && clampedSinPixel(pt - 1, lineduration) > k) {
+				--pt;
+			}
+			while (pt <= lineduration && clampedSinPixel(pt, lineduration) <= k) {
+				++pt;
+			}
+			tab.boundary[k] = pt;
+		}
+		// buckets are a fraction of the narrowest pixel, so only few boundaries need to be checked
+		tab.shift = 0;
+		while ((int64_t(2) << tab.shift) * pix_x * 4 <= lineduration) {
+			++tab.shift;
+		}
+		tab.bucket_x.resize(size_t((lineduration >> tab.shift) + 1));
+		uint32_t x = 0;
+		for (size_t j = 0; j < tab.bucket_x.size(); ++j) {
+			while (x < uint32_t(pix_x - 1) && tab.boundary[x] <= (int64_t(j) << tab.shift)) {
+				++x;
+			}
+			tab.bucket_x[j] = x;
+		}
+		return tab;
+	};
+	void setPlaneChannels(const std::vector<int>& plane_channels)
+	{
+		assert(plane_channels.size() <= MAX_PLANES);
+		for (size_t p = 0; p < plane_channels.size(); ++p) {
+			for (int ch = 0; ch < int(planes_of_channel.size()); ++ch) {
+				if (plane_channels[p] == SUM_OF_CHANNELS || plane_channels[p] == ch) {
+					planes_of_channel[ch] |= uint64_t(1) << p;
+				}
+			}
+		}
+		if (sin_correction != 0) {
+			sin_corr_scale = std::sin(M_PI * sin_correction / 200.0);
+		}
+	};
+	// calls f(pixel, dtime, plane) for the photons of a line
+	template<class F> void forEachPhoton(int64_t linecounter, int64_t lineduration,
+		const std::vector<PixelTime>& pixeltimes, F&& f)
+	{
+		size_t linestart = size_t((linecounter / bin_xy - band_first) * image_pix_x);
+		forEachPhotonX(linecounter, lineduration, pixeltimes, [&](const PixelTime& pt, uint64_t planes, int64_t x) {
+			size_t pixel = linestart + size_t(x / bin_xy);
+			uint32_t dt = uint32_t(pt.dtime / bin_t);
+			do {
+				f(pixel, dt, uint32_t(std::countr_zero(planes)));
+				planes &= planes - 1;
+			} while (planes);
+			});
+	};
+	// common part of the public constructors
+	HistogramBinner(const std::vector<int>& plane_channels, const PTUFileHeader& fh) :
+		planes_of_channel{},
+		pix_x{ fh.pix_x }, sin_correction{ fh.sin_correction },
+		bin_xy{ 1 }, bin_t{ 1 }, image_pix_x{ fh.pix_x },
+		band_first{ 0 }, band_lines{ std::numeric_limits<int64_t>::max() }, sin_corr_scale{},
+		is_bidirect{ fh.is_bidirect }, use_sin_table{ fh.sin_correction > 0 && fh.sin_correction <= 100 },
+		next_sin_table{ 0 }, maxDtime(plane_channels.size(), 0)
+	{
+		setPlaneChannels(plane_channels);
+	};
+public:
+	static constexpr size_t MAX_PLANES = 64;
+	std::vector<uint32_t> maxDtime; // max val in histogram, per plane
+	std::vector<PendingPhoton> pending; // counted by flush()
+
+	// event mode: no planes, photons are only mapped to pixels (see forEachPhotonX())
+	static HistogramBinner EventMapper(const std::vector<int>& plane_channels, const PTUFileHeader& fh)
+	{
+		return HistogramBinner(plane_channels, fh);
+	};
+	// calls f(photon, planes, x) for the photons of a line that go into any plane,
+	// x is the column in the image (without binning)
+	template<class F> void forEachPhotonX(int64_t linecounter, int64_t lineduration,
+		const std::vector<PixelTime>& pixeltimes, F&& f)
+	{
+		const SinPixelTable* tab = (use_sin_table && lineduration > 0) ? &sinTable(lineduration) : nullptr;
+		for (const auto& pt : pixeltimes) {
+			uint64_t planes = planes_of_channel[pt.channel & 63];
+			if (planes == 0) {
+				continue;
+			}
+			int64_t x;
+			if (sin_correction == 0) {
+				x = int64_t(pt.pixeltime) * pix_x / lineduration;
+			}
+			else if (tab && pt.pixeltime >= 0 && pt.pixeltime <= lineduration) {
+				// look up pixel
+				uint32_t xi = tab->bucket_x[size_t(pt.pixeltime >> tab->shift)];
+				while (xi < uint32_t(pix_x - 1) && tab->boundary[xi] <= pt.pixeltime) {
+					++xi;
+				}
+				x = xi;
+			}
+			else {
+				x = sinPixel(pt.pixeltime, lineduration);
+			}
+			x = std::max(int64_t(0), std::min(x, pix_x - 1));
+			if (is_bidirect && bool(linecounter & 1)) {
+				x = pix_x - 1 - x;
+			}
+			f(pt, planes, x);
+		}
+	};
+
+	// histograms[p] collects the photons of channel plane_channels[p] (SUM_OF_CHANNELS: all channels)
+	HistogramBinner(const std::vector<CompactHistogram*>& Histograms, const std::vector<int>& plane_channels,
+		const PTUFileHeader& fh) : HistogramBinner(plane_channels, fh)
+	{
+		assert(Histograms.size() == plane_channels.size());
+		histograms = Histograms;
+	};
+	// phasor mode, phasors[p] collects the photons of channel plane_channels[p]
+	HistogramBinner(const std::vector<PhasorImage*>& Phasors, const std::vector<int>& plane_channels,
+		const PTUFileHeader& fh) : HistogramBinner(plane_channels, fh)
+	{
+		assert(Phasors.size() == plane_channels.size());
+		phasors = Phasors;
+	};
+	// intensity mode, meantimes[p] collects the photons of channel plane_channels[p]
+	HistogramBinner(const std::vector<MeanTimeImage*>& Meantimes, const std::vector<int>& plane_channels,
+		const PTUFileHeader& fh) : HistogramBinner(plane_channels, fh)
+	{
+		assert(Meantimes.size() == plane_channels.size());
+		meantimes = Meantimes;
+	};
+	// gate mode, gateimages[p] collects the photons of channel plane_channels[p]
+	HistogramBinner(const std::vector<GateImages*>& Gateimages, const std::vector<int>& plane_channels,
+		const PTUFileHeader& fh) : HistogramBinner(plane_channels, fh)
+	{
+		assert(Gateimages.size() == plane_channels.size());
+		gateimages = Gateimages;
+	};
+
+	// Bin Bin_xy x Bin_xy pixels and Bin_t Dtime channels into one. The planes
+	// must have (pix_x / Bin_xy) x (pix_y / Bin_xy) pixels (rounded up).
+	// Call before binning.
+	void setBinning(int64_t Bin_xy, int64_t Bin_t)
+	{
+		assert(Bin_xy >= 1 && Bin_t >= 1);
+		bin_xy = Bin_xy;
+		bin_t = Bin_t;
+		image_pix_x = BinnedSize(pix_x, bin_xy);
+	};
+	// Histograms only: the planes hold image lines First ... First + Lines - 1 only.
+	// Photons of other lines are not counted, but still go into maxDtime,
+	// so maxDtime is that of the whole image. Call before binning.
+	void setBand(int64_t First, int64_t Lines)
+	{
+		band_first = First;
+		band_lines = Lines;
+	};
+	// for copies that bin concurrently: the time axis is not grown right away,
+	// photons beyond it are kept in pending until flush()
+	void deferGrowth() { defer_growth = true; };
+	// line of the (binned) image that linecounter goes to
+	int64_t imageLine(int64_t linecounter) const { return linecounter / bin_xy; };
+	static int64_t BinnedSize(int64_t size, int64_t bin) { return (size + bin - 1) / bin; };
+
+	void binLine(int64_t linecounter, int64_t lineduration, const std::vector<PixelTime>& pixeltimes)
+	{
+		if (!phasors.empty()) {
+			forEachPhoton(linecounter, lineduration, pixeltimes, [this](size_t pixel, uint32_t dt, uint32_t p) {
+				if (phasors[p]->add(pixel, dt)) {
+					maxDtime[p] = std::max(dt, maxDtime[p]);
+				}
+				});
+			return;
+		}
+		if (!gateimages.empty()) {
+			forEachPhoton(linecounter, lineduration, pixeltimes, [this](size_t pixel, uint32_t dt, uint32_t p) {
+				if (gateimages[p]->add(pixel, dt)) {
+					maxDtime[p] = std::max(dt, maxDtime[p]);
+				}
+				});
+			return;
+		}
+		if (!meantimes.empty()) {
+			forEachPhoton(linecounter, lineduration, pixeltimes, [this](size_t pixel, uint32_t dt, uint32_t p) {
+				if (meantimes[p]->add(pixel, dt)) {
+					maxDtime[p] = std::max(dt, maxDtime[p]);
+				}
+				});
+			return;
+		}
+		if (uint64_t(imageLine(linecounter) - band_first) >= uint64_t(band_lines)) {
+			forEachPhotonX(linecounter, lineduration, pixeltimes, [this](const PixelTime& pt, uint64_t planes, int64_t) {
+				uint32_t dt = uint32_t(pt.dtime / bin_t);
+				do {
+					auto p = std::countr_zero(planes);
+					if (dt < histograms[p]->maxChannels()) {
+						maxDtime[p] = std::max(dt, maxDtime[p]);
+					}
+					planes &= planes - 1;
+				} while (planes);
+				});
+			return;
+		}
+		forEachPhoton(linecounter, lineduration, pixeltimes, [this](size_t pixel, uint32_t dt, uint32_t p) {
+			auto histogram = histograms[p];
+			if (dt < histogram->maxChannels()) {
+				if (!histogram->add(pixel, dt)) {
+					if (defer_growth) {
+						pending.push_back({ pixel, dt, p });
+					}
+					else {
+						histogram->grow(size_t(dt) + 1);
+						histogram->add(pixel, dt);
+					}
+				}
+				maxDtime[p] = std::max(dt, maxDtime[p]);
+			}
+			});
+	};
+	// grow time axis as needed and count pending photons
+	// (must not be called while other copies are binning)
+	void flush()
+	{
+		for (const auto& p : pending) {
+			histograms[p.plane]->grow(size_t(p.dtime) + 1);
+			histograms[p.plane]->add(p.pixel, p.dtime);
+		}
+		pending.clear();
+	};
+};
@@ -0,0 +1,132 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+
+#include <cstring>
+#include <new>
+#include "LazyZeroBuffer.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	// below this, clearing is done by writing zeros
+	constexpr size_t MIN_REMAP_BYTES = size_t(256) << 10;
+	constexpr size_t HUGE_PAGE_SIZE = size_t(2) << 20;
+
+	size_t PageSize()
+	{
+#ifdef _WIN32
+		SYSTEM_INFO si{};
+		GetSystemInfo(&si);
+		return si.dwPageSize;
+#else
+		return size_t(sysconf(_SC_PAGESIZE));
+#endif
+	}
+
+	size_t RoundUp(size_t n, size_t multiple)
+	{
+		return (n + multiple - 1) / multiple * multiple;
+	}
+}
+
+void LazyZeroBuffer::map(size_t bytes)
+{
+	// with huge pages, the mapping is aligned to (and a multiple of) the huge page size
+	size_t length = RoundUp(bytes, huge_pages ? HUGE_PAGE_SIZE : PageSize());
+#ifdef _WIN32
+	// (large pages need special privileges on Windows and cannot be committed lazily, so they are not used)
+	base = VirtualAlloc(nullptr, length, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (!base) {
+		throw std::bad_alloc();
+	}
+#else
+	size_t extra = huge_pages ? HUGE_PAGE_SIZE : 0;
+	void* p = mmap(nullptr, length + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		throw std::bad_alloc();
+	}
+	char* start = static_cast<char*>(p);
+	if (extra > 0) {
+		char* aligned = reinterpret_cast<char*>(RoundUp(reinterpret_cast<size_t>(start), HUGE_PAGE_SIZE));
+		if (aligned > start) {
+			munmap(start, size_t(aligned - start));
+		}
+		if (size_t tail = size_t(start + length + extra - (aligned + length)); tail > 0) {
+			munmap(aligned + length, tail);
+		}
+		start = aligned;
+#ifdef MADV_HUGEPAGE
+		madvise(start, length, MADV_HUGEPAGE);
+#endif
+	}
+	base = start;
+#endif
+	capacity = length;
+	dirty = 0;
+}
+
+void LazyZeroBuffer::unmap()
+{
+	if (base) {
+#ifdef _WIN32
+		VirtualFree(base, 0, MEM_RELEASE);
+#else
+		munmap(base, capacity);
+#endif
+	}
+	base = nullptr;
+	capacity = dirty = 0;
+}
+
+void LazyZeroBuffer::clear(size_t bytes)
+{
+	if (bytes < MIN_REMAP_BYTES) {
+		std::memset(base, 0, bytes);
+		return;
+	}
+	// replace the pages by fresh ones, they are zeroed on demand
+	size_t length = RoundUp(bytes, huge_pages ? HUGE_PAGE_SIZE : PageSize());
+#ifdef _WIN32
+	VirtualFree(base, length, MEM_DECOMMIT);
+	if (!VirtualAlloc(base, length, MEM_COMMIT, PAGE_READWRITE)) {
+		unmap();
+		throw std::bad_alloc();
+	}
+#else
+	if (mmap(base, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+		unmap();
+		throw std::bad_alloc();
+	}
+#ifdef MADV_HUGEPAGE
+	if (huge_pages) {
+		madvise(base, length, MADV_HUGEPAGE);
+	}
+#endif
+#endif
+}
+
+void* LazyZeroBuffer::zeroed(size_t bytes, bool Huge_pages)
+{
+#ifdef _WIN32
+	Huge_pages = false;
+#endif
+	if (bytes == 0) {
+		return base;
+	}
+	if (bytes > capacity || Huge_pages != huge_pages) {
+		unmap();
+		huge_pages = Huge_pages;
+		map(bytes);
+	}
+	else if (dirty > 0) {
+		clear(dirty);
+	}
+	dirty = bytes;
+	return base;
+}
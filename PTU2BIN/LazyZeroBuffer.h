@@ -0,0 +1,44 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+//
+// Memory for large zero-initialized arrays (like the histogram), taken directly
+// from the OS as an anonymous mapping. Pages are committed, and zeroed by the OS,
+// only when they are first touched, so the parts of an array that are never used
+// cost neither time nor memory. The mapping is kept for reuse, clearing it
+// just gives the touched pages back. Optionally, transparent huge pages are used
+// (Linux only), which means fewer page faults for densely used arrays.
+
+#pragma once
+#include <cstddef>
+#include <utility>
+
+class LazyZeroBuffer
+{
+	void* base;
+	size_t capacity, // bytes mapped
+		dirty; // bytes at start that may have been written to
+	bool huge_pages;
+
+	void map(size_t bytes);
+	void unmap();
+	void clear(size_t bytes); // zero first bytes (page aligned up)
+public:
+	LazyZeroBuffer() : base{ nullptr }, capacity{ 0 }, dirty{ 0 }, huge_pages{ false } {};
+	~LazyZeroBuffer() { unmap(); };
+	LazyZeroBuffer(const LazyZeroBuffer&) = delete;
+	LazyZeroBuffer& operator=(const LazyZeroBuffer&) = delete;
+	void swap(LazyZeroBuffer& other) noexcept
+	{
+		std::swap(base, other.base);
+		std::swap(capacity, other.capacity);
+		std::swap(dirty, other.dirty);
+		std::swap(huge_pages, other.huge_pages);
+	};
+
+	// returns memory for bytes bytes, all zero (the mapping is reused if it is large enough,
+	// everything written before is lost); throws std::bad_alloc
+	void* zeroed(size_t bytes, bool Huge_pages = false);
+	// give mapping back
+	void release() { unmap(); };
+	size_t bytesMapped() const { return capacity; };
+};
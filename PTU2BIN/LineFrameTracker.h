@@ -0,0 +1,200 @@
+// (c) 2021 - 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+//
+// Keeps track of lines and frames while the marker events
+// of an image scan are processed.
+
+#pragma once
+#include <cstdint>
+#include <cassert>
+#include <string>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include "PTUFileHeader.h"
+
+enum FRAME_TRIGGER_TYPE {
+	FRAMETRG_UNKNOW = 0,
+	FRAMETRG_AT_START = 1,
+	FRAMETRG_AT_STOP = 2
+};
+
+// Frames that should be processed, a sorted list of non-overlapping ranges.
+// With a step > 1, only every step-th frame (counting from first()) is processed.
+class FrameSelection
+{
+public:
+	struct Range {
+		int64_t first, last;
+	};
+private:
+	std::vector<Range> ranges;
+	int64_t frame_step{ 1 };
+public:
+	FrameSelection(int64_t first_frame = 0, int64_t last_frame = std::numeric_limits<int64_t>::max())
+	{
+		if (first_frame <= last_frame) {
+			ranges.push_back({ first_frame, last_frame });
+		}
+	};
+	// parse list like "3,7,10-20", throws std::invalid_argument
+	static FrameSelection parse(const std::string& list)
+	{
+		FrameSelection sel(1, 0); // empty
+		size_t pos = 0;
+		while (pos <= list.size()) {
+			auto next = std::min(list.find(',', pos), list.size());
+			auto item = list.substr(pos, next - pos);
+			auto dash = item.find('-', 1);
+			size_t n1{}, n2{};
+			int64_t first{}, last{};
+			try {
+				first = last = std::stoll(item, &n1);
+				if (dash != std::string::npos) {
+					last = std::stoll(item.substr(dash + 1), &n2);
+					n1 += n2 + 1;
+				}
+			}
+			catch (const std::logic_error&) { // thrown by stoll
+				n1 = 0;
+			}
+			if (n1 != item.size() || item.empty() || first < 0 || last < first) {
+				throw std::invalid_argument("invalid frame list item '" + item + "'");
+			}
+			sel.ranges.push_back({ first, last });
+			pos = next + 1;
+		}
+		std::sort(sel.ranges.begin(), sel.ranges.end(), [](const Range& a, const Range& b) { return a.first < b.first; });
+		std::vector<Range> merged;
+		for (const auto& r : sel.ranges) {
+			if (!merged.empty() && r.first <= merged.back().last + 1) {
+				merged.back().last = std::max(merged.back().last, r.last);
+			}
+			else {
+				merged.push_back(r);
+			}
+		}
+		sel.ranges = std::move(merged);
+		return sel;
+	};
+	bool empty() const { return ranges.empty(); };
+	int64_t first() const { return ranges.empty() ? 0 : ranges.front().first; };
+	int64_t last() const { return ranges.empty() ? -1 : ranges.back().last; };
+	const std::vector<Range>& runs() const { return ranges; };
+	int64_t step() const { return frame_step; };
+	void setStep(int64_t Step) { frame_step = std::max(int64_t(1), Step); };
+	bool contains(int64_t frame) const
+	{
+		if (frame_step > 1 && (frame - first()) % frame_step != 0) {
+			return false;
+		}
+		for (const auto& r : ranges) {
+			if (frame < r.first) {
+				return false;
+			}
+			if (frame <= r.last) {
+				return true;
+			}
+		}
+		return false;
+	};
+};
+
+// the state of the tracker, can be saved and restored
+struct ScanState {
+	bool isrecordingline, framehasstarted;
+	int64_t lastlinestart, lastlinestop, lineduration, linecounter,
+		totallines, framecounter, lastframetime, linesprocessed,
+		frametrgcount, // as a control we count the frame triggers
+		ended_line; // after LINE_ENDED: # of the line if it goes into the histogram, -1 otherwise
+};
+
+class LineFrameTracker : public ScanState
+{
+	int64_t pix_y, lines_to_skip;
+	FrameSelection frames;
+	int frame_trg_type;
+	unsigned int TrgLineStartMask, TrgLineStopMask, TrgFrameMask;
+	bool frame_selected; // current frame is to be processed
+public:
+	// events reported by processMarker()
+	enum EVENTS {
+		LINE_STARTED = 1, // start of line recording, lastlinestart has been (re)set
+		LINE_ENDED = 2 // line recording ended, see ended_line
+	};
+
+	LineFrameTracker(const PTUFileHeader& fh, int Frame_trg_type, int64_t Lines_to_skip,
+		const FrameSelection& Frames) :
+		ScanState{ false, Frame_trg_type != FRAMETRG_AT_START, -1, -1, -1, -Lines_to_skip,
+			0, 0, -1, 0, 0, -1 },
+		pix_y{ fh.pix_y }, lines_to_skip{ Lines_to_skip }, frames{ Frames },
+		frame_trg_type{ Frame_trg_type },
+		TrgLineStartMask{ 1u << (fh.trg_linestart - 1) }, TrgLineStopMask{ 1u << (fh.trg_linestop - 1) },
+		TrgFrameMask{ 1u << (fh.trg_frame - 1) },
+		frame_selected{ Frames.contains(0) } {};
+
+	const ScanState& state() const { return *this; };
+	void restore(const ScanState& s)
+	{
+		static_cast<ScanState&>(*this) = s;
+		frame_selected = frames.contains(framecounter);
+	};
+	bool frameSelected() const { return frame_selected; };
+	// true if photons arriving now belong to a line that will be processed
+	bool acceptsPhotons() const { return isrecordingline && frame_selected; };
+
+	// process (merged) marker event, returns combination of EVENTS
+	int processMarker(unsigned int trigger, int64_t truensync)
+	{
+		int events = 0;
+		if ((trigger & TrgFrameMask) && frame_trg_type == FRAMETRG_AT_START) {
+			framehasstarted = true;
+			lastframetime = truensync;
+			linecounter = 0; // this also signals that line should be processed
+		}
+		if (framehasstarted && (trigger & TrgLineStartMask)) {
+			++totallines;
+			if (linecounter >= 0) {
+				isrecordingline = true;
+				lastlinestart = truensync;
+				events |= LINE_STARTED;
+			}
+			else {
+				++linecounter;
+			}
+		}
+		else if ((trigger & TrgLineStopMask) && isrecordingline) { // line ended
+			isrecordingline = false;
+			lastlinestop = truensync;
+			lineduration = lastlinestop - lastlinestart;
+			assert(linecounter < pix_y);
+			events |= LINE_ENDED;
+			if (frame_selected && (linecounter < pix_y)) {
+				++linesprocessed;
+				ended_line = linecounter;
+			}
+			else {
+				ended_line = -1;
+			}
+			++linecounter;
+			if (linecounter == pix_y) {
+				++framecounter;
+				frame_selected = frames.contains(framecounter);
+
+				// for unknown frame trigger we assume we are always recording
+				if (frame_trg_type != FRAMETRG_UNKNOW) { framehasstarted = false; }
+				linecounter = -lines_to_skip;  // skip lines if necessary (in fact, this will also be set if frame trigger got caught)
+			}
+		}
+		if ((trigger & TrgFrameMask) && frame_trg_type == FRAMETRG_AT_STOP) {
+			framehasstarted = true;
+			lastframetime = truensync;
+			linecounter = -lines_to_skip;
+		}
+		if (trigger & TrgFrameMask) {
+			++frametrgcount;
+		}
+		return events;
+	};
+};
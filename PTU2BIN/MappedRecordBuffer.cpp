@@ -0,0 +1,109 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+
+#include <algorithm>
+#include "MappedRecordBuffer.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Consumed pages are given back in chunks of this size.
+// Must be a multiple of the page size.
+constexpr size_t RELEASE_CHUNK = size_t(64) << 20;
+
+MappedRecordBuffer::MappedRecordBuffer(const std::string& filename, size_t offset, size_t num_records) :
+	records{ nullptr }, numrecords{ num_records }, idx{ 0 }, checkpoint{ 0 },
+	mapbase{ nullptr }, maplength{ offset + num_records * sizeof(uint32_t) }, released{ 0 }
+#ifdef _WIN32
+	, hFile{ INVALID_HANDLE_VALUE }, hMapping{ nullptr }
+#endif
+{
+	if (offset % alignof(uint32_t) != 0) {
+		throw std::runtime_error("TTTR records are not aligned");
+	}
+#ifdef _WIN32
+	hFile = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("cannot open file for mapping");
+	}
+	LARGE_INTEGER filesize{};
+	if (!GetFileSizeEx(hFile, &filesize) || size_t(filesize.QuadPart) < maplength) {
+		CloseHandle(hFile);
+		throw std::runtime_error("Error while reading TTTR records from infile. Unexpected end of file.");
+	}
+	hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (hMapping) {
+		mapbase = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, maplength);
+	}
+	if (!mapbase) {
+		if (hMapping) {
+			CloseHandle(hMapping);
+		}
+		CloseHandle(hFile);
+		throw std::runtime_error("cannot map file");
+	}
+#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("cannot open file for mapping");
+	}
+	struct stat st {};
+	if (fstat(fd, &st) != 0 || size_t(st.st_size) < maplength) {
+		close(fd);
+		throw std::runtime_error("Error while reading TTTR records from infile. Unexpected end of file.");
+	}
+	mapbase = mmap(nullptr, maplength, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (mapbase == MAP_FAILED) {
+		close(fd);
+		throw std::runtime_error("cannot map file");
+	}
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(fd, off_t(offset), 0, POSIX_FADV_SEQUENTIAL); // more aggressive read-ahead
+#endif
+	close(fd); // mapping stays valid
+	madvise(mapbase, maplength, MADV_SEQUENTIAL);
+#endif
+	records = reinterpret_cast<const uint32_t*>(static_cast<const char*>(mapbase) + offset);
+	releaseConsumed(); // sets first checkpoint
+}
+
+MappedRecordBuffer::~MappedRecordBuffer()
+{
+#ifdef _WIN32
+	UnmapViewOfFile(mapbase);
+	CloseHandle(hMapping);
+	CloseHandle(hFile);
+#else
+	munmap(mapbase, maplength);
+#endif
+}
+
+void MappedRecordBuffer::releaseConsumed()
+{
+	size_t headbytes = size_t(reinterpret_cast<const char*>(records) - static_cast<const char*>(mapbase));
+	size_t consumed = headbytes + idx * sizeof(uint32_t);
+	size_t releasable = consumed / RELEASE_CHUNK * RELEASE_CHUNK;
+	if (releasable < released) { // we have been rewound
+		released = 0;
+	}
+	if (releasable > released) {
+#ifndef _WIN32
+		// pages of a private read-only file mapping are simply dropped,
+		// accessing them again would re-read them from the file
+		madvise(static_cast<char*>(mapbase) + released, releasable - released, MADV_DONTNEED);
+#endif
+		// On Windows pages of file-backed views cannot be discarded explicitly,
+		// the working set manager trims them for us.
+		released = releasable;
+	}
+	size_t nextrelease = released + RELEASE_CHUNK;
+	checkpoint = std::min(numrecords, (nextrelease - headbytes + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+}
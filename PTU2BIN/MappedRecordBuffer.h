@@ -0,0 +1,68 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+//
+// Zero-copy access to the TTTR records of a PTU file via memory mapping.
+// Offers the same pop()/peek()/rewind() interface as RecordBuffer, so that
+// all record processing code can run against either source.
+
+#pragma once
+#include <stdexcept>
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <string>
+#include <algorithm>
+
+class MappedRecordBuffer
+{
+	const uint32_t* records; // first record (inside mapping)
+	size_t numrecords, idx,
+		checkpoint; // next index at which pop() needs to do some housekeeping
+	void* mapbase; // start of mapping (page aligned)
+	size_t maplength,
+		released; // number of bytes at start of mapping already given back to the OS
+#ifdef _WIN32
+	void* hFile, * hMapping;
+#endif
+
+	void releaseConsumed(); // drop pages that have been consumed
+	void housekeeping() {
+		if (idx >= numrecords) {
+			throw std::range_error("trying to read from empty buffer (no more data)");
+		}
+		releaseConsumed();
+	};
+public:
+	// records start at byte 'offset' of the file; throws std::runtime_error
+	// if the file cannot be mapped
+	MappedRecordBuffer(const std::string& filename, size_t offset, size_t num_records);
+	~MappedRecordBuffer();
+	MappedRecordBuffer(const MappedRecordBuffer&) = delete;
+	MappedRecordBuffer& operator=(const MappedRecordBuffer&) = delete;
+
+	// all records as a contiguous array
+	std::span<const uint32_t> span() const { return { records, numrecords }; };
+	bool noMoreData() const { return idx == numrecords; };
+	// rewind to first record, this is (almost) free since nothing needs to be re-read
+	void rewind() {
+		seek(0);
+	};
+	void seek(size_t recordindex) { // continue with given record
+		idx = std::min(recordindex, numrecords);
+		releaseConsumed();
+	};
+	// return and remove top element:
+	uint32_t pop() {
+		if (idx >= checkpoint) {
+			housekeeping();
+		}
+		return records[idx++];
+	}
+	// return but not remove top element:
+	uint32_t peek() const {
+		if (idx == numrecords) {
+			throw std::range_error("tried to peek past last record");
+		}
+		return records[idx];
+	}
+};
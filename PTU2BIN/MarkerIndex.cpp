@@ -0,0 +1,136 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+
+#include <fstream>
+#include <cstring>
+#include "MarkerIndex.h"
+
+namespace {
+	constexpr char INDEX_MAGIC[8] = { 'P','T','U','I','D','X','0','1' };
+
+	// all values are written as 8 byte little endian (i.e. native) values
+	// one by one, so the file layout does not depend on struct padding
+	template<class T> void put(std::ostream& os, T val)
+	{
+		static_assert(sizeof(T) == 8, "only 8 byte values");
+		os.write((const char*)&val, sizeof(val));
+	}
+	template<class T> void get(std::istream& is, T& val)
+	{
+		static_assert(sizeof(T) == 8, "only 8 byte values");
+		is.read((char*)&val, sizeof(val));
+	}
+
+	void putKey(std::ostream& os, const MarkerIndex::Key& k)
+	{
+		put(os, k.filesize); put(os, k.records_offset);
+		put(os, k.num_records); put(os, k.record_type); put(os, k.pix_x); put(os, k.pix_y);
+		put(os, k.trg_frame); put(os, k.trg_linestart); put(os, k.trg_linestop);
+		put(os, k.GlobRes);
+		put(os, k.frame_trg_type); put(os, k.lines_to_skip); put(os, k.ignore_frame_trigger);
+	}
+	void getKey(std::istream& is, MarkerIndex::Key& k)
+	{
+		get(is, k.filesize); get(is, k.records_offset);
+		get(is, k.num_records); get(is, k.record_type); get(is, k.pix_x); get(is, k.pix_y);
+		get(is, k.trg_frame); get(is, k.trg_linestart); get(is, k.trg_linestop);
+		get(is, k.GlobRes);
+		get(is, k.frame_trg_type); get(is, k.lines_to_skip); get(is, k.ignore_frame_trigger);
+	}
+
+	void putFrame(std::ostream& os, const MarkerIndex::FrameEntry& f)
+	{
+		put(os, f.record); put(os, f.oflcorrection);
+		const auto& s = f.state;
+		put(os, int64_t(s.isrecordingline)); put(os, int64_t(s.framehasstarted));
+		put(os, s.lastlinestart); put(os, s.lastlinestop); put(os, s.lineduration); put(os, s.linecounter);
+		put(os, s.totallines); put(os, s.framecounter); put(os, s.lastframetime); put(os, s.linesprocessed);
+		put(os, s.frametrgcount); put(os, s.ended_line);
+	}
+	void getFrame(std::istream& is, MarkerIndex::FrameEntry& f)
+	{
+		get(is, f.record); get(is, f.oflcorrection);
+		auto& s = f.state;
+		int64_t isrecordingline{}, framehasstarted{};
+		get(is, isrecordingline); get(is, framehasstarted);
+		s.isrecordingline = isrecordingline != 0;
+		s.framehasstarted = framehasstarted != 0;
+		get(is, s.lastlinestart); get(is, s.lastlinestop); get(is, s.lineduration); get(is, s.linecounter);
+		get(is, s.totallines); get(is, s.framecounter); get(is, s.lastframetime); get(is, s.linesprocessed);
+		get(is, s.frametrgcount); get(is, s.ended_line);
+	}
+}
+
+MarkerIndex::MarkerIndex(const PTUFileHeader& fh, uint64_t filesize, uint64_t records_offset,
+	int frame_trg_type, int64_t lines_to_skip, bool ignore_frame_trigger)
+{
+	key = { filesize, records_offset, fh.num_records, fh.record_type, fh.pix_x, fh.pix_y,
+		fh.trg_frame, fh.trg_linestart, fh.trg_linestop, fh.GlobRes,
+		frame_trg_type, lines_to_skip, ignore_frame_trigger };
+}
+
+bool MarkerIndex::load(const std::string& filename, const Key& expected_key)
+{
+	std::ifstream is(filename, std::ios::in | std::ios::binary);
+	char magic[sizeof(INDEX_MAGIC)]{};
+	if (!is.read(magic, sizeof(magic)).good() || std::memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0) {
+		return false;
+	}
+	Key k{};
+	getKey(is, k);
+	// when the trigger settings come from the index, they are not known beforehand
+	auto expected = expected_key;
+	if (!expected.ignore_frame_trigger) {
+		expected.frame_trg_type = k.frame_trg_type;
+		expected.lines_to_skip = k.lines_to_skip;
+	}
+	if (!is.good() || !(k == expected)) {
+		return false;
+	}
+	uint64_t numframes{}, numlines{};
+	get(is, numframes);
+	get(is, numlines);
+	if (!is.good() || numframes > uint64_t(k.num_records) || numlines > uint64_t(k.num_records)) {
+		return false;
+	}
+	frames.resize(numframes);
+	for (auto& f : frames) {
+		getFrame(is, f);
+	}
+	getFrame(is, final);
+	lines.resize(numlines);
+	for (auto& l : lines) {
+		get(is, l.record); get(is, l.truesync); get(is, l.oflcorrection);
+		get(is, l.frame); get(is, l.line);
+	}
+	if (!is.good()) {
+		frames.clear();
+		lines.clear();
+		return false;
+	}
+	key = k;
+	return true;
+}
+
+bool MarkerIndex::save(const std::string& filename) const
+{
+	std::ofstream os(filename, std::ios::out | std::ios::binary);
+	os.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	putKey(os, key);
+	put(os, uint64_t(frames.size()));
+	put(os, uint64_t(lines.size()));
+	for (const auto& f : frames) {
+		putFrame(os, f);
+	}
+	putFrame(os, final);
+	for (const auto& l : lines) {
+		put(os, l.record); put(os, l.truesync); put(os, l.oflcorrection);
+		put(os, l.frame); put(os, l.line);
+	}
+	return os.good();
+}
+
+std::string MarkerIndexFileName(const std::string& ptufilename)
+{
+	return ptufilename + ".idx";
+}
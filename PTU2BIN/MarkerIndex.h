@@ -0,0 +1,74 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+//
+// Index of the frames and lines of a PTU file, stored in a sidecar file
+// (<infile>.idx). With the index, selected frames can be decoded
+// without processing the file from the start.
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "PTUFileHeader.h"
+#include "LineFrameTracker.h"
+
+class MarkerIndex
+{
+public:
+	// everything the index depends on, a stale or foreign index will not match
+	struct Key {
+		uint64_t filesize, records_offset;
+		int64_t num_records, record_type, pix_x, pix_y,
+			trg_frame, trg_linestart, trg_linestop;
+		double GlobRes;
+		int64_t frame_trg_type, lines_to_skip, ignore_frame_trigger;
+		bool operator==(const Key&) const = default;
+	};
+	// where decoding of a frame can start
+	struct FrameEntry {
+		uint64_t record; // index of first record after the frame has started
+		int64_t oflcorrection; // overflow correction in force at that record
+		ScanState state; // of the tracker
+	};
+	struct LineEntry {
+		uint64_t record; // index of line start marker record
+		int64_t truesync, oflcorrection;
+		int64_t frame, line;
+	};
+
+	Key key{};
+	std::vector<FrameEntry> frames; // frames[f] is start of frame f (last one might be incomplete)
+	FrameEntry final{}; // state after last record
+	std::vector<LineEntry> lines; // all recorded lines
+	bool frames_only{ false }; // lines are not recorded (index only kept in memory)
+
+	MarkerIndex() = default;
+	MarkerIndex(const PTUFileHeader& fh, uint64_t filesize, uint64_t records_offset,
+		int frame_trg_type, int64_t lines_to_skip, bool ignore_frame_trigger);
+
+	// helpers for building the index
+	void addFrame(uint64_t record, int64_t oflcorrection, const ScanState& state)
+	{
+		frames.push_back({ record, oflcorrection, state });
+	};
+	void addLine(uint64_t record, int64_t truesync, int64_t oflcorrection, const ScanState& state)
+	{
+		if (frames_only) {
+			return;
+		}
+		lines.push_back({ record, truesync, oflcorrection, state.framecounter, state.linecounter });
+	};
+
+	// record range [begin, end) that needs to be decoded for frames first...last
+	uint64_t beginRecord(int64_t first) const { return frames.at(first).record; };
+	uint64_t endRecord(int64_t last) const {
+		return (size_t(last) + 1 < frames.size()) ? frames[last + 1].record : uint64_t(key.num_records);
+	};
+
+	// false if file cannot be read or index does not belong to expected_key
+	bool load(const std::string& filename, const Key& expected_key);
+	bool save(const std::string& filename) const;
+};
+
+// name of sidecar file
+std::string MarkerIndexFileName(const std::string& ptufilename);
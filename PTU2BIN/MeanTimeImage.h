@@ -0,0 +1,59 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+//
+// Intensity and mean arrival time images for a quick look at a file.
+// Per pixel, only the photon count and the sum of Dtime are kept
+// (struct of arrays, so the count image can be written as it is).
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class MeanTimeImage
+{
+	size_t numpixels, channels;
+	std::vector<uint32_t> counts; // numpixels
+	std::vector<uint64_t> dtime_sums; // numpixels
+public:
+	MeanTimeImage() : numpixels{ 0 }, channels{ 0 } {};
+	MeanTimeImage(const MeanTimeImage&) = delete;
+	MeanTimeImage& operator=(const MeanTimeImage&) = delete;
+
+	// clear and set up for new image, Dtime 0 ... Channels-1 are used
+	void reset(size_t Numpixels, size_t Channels)
+	{
+		numpixels = Numpixels;
+		channels = Channels;
+		counts.assign(numpixels, 0);
+		dtime_sums.assign(numpixels, 0);
+	};
+
+	size_t numPixels() const { return numpixels; };
+	size_t bytes() const { return counts.size() * sizeof(uint32_t) + dtime_sums.size() * sizeof(uint64_t); };
+
+	// count photon, returns false (and does not count) if dt is out of range.
+	// May be called concurrently for different pixels.
+	bool add(size_t pixel, uint32_t dt)
+	{
+		if (dt >= channels) {
+			return false;
+		}
+		++counts[pixel];
+		dtime_sums[pixel] += dt;
+		return true;
+	};
+
+	const std::vector<uint32_t>& intensity() const { return counts; };
+	// mean arrival time in units of resolution, 0 for pixels without photons
+	std::vector<float> meanTime(double resolution) const
+	{
+		std::vector<float> img(numpixels);
+		for (size_t p = 0; p < numpixels; ++p) {
+			if (counts[p] > 0) {
+				img[p] = float(double(dtime_sums[p]) / counts[p] * resolution);
+			}
+		}
+		return img;
+	};
+};
@@ -8,30 +8,17 @@
 // (see their GitHub repo)
 //
 
-#define _USE_MATH_DEFINES
-#include <cmath>
 #include <iostream>
-#include <fstream>
+#include <sstream>
 #include <string>
 #include <vector>
-#include <array>
 #include <algorithm>
-#include <iterator>
-#include <limits>
-#include <memory>
+#include <thread>
 #include <cstdint>
-#include <cstring>
-#include <cassert>
-#include <cstdio>
-//#include <numbers>
-#ifndef __STDC_WANT_LIB_EXT1__
-#define __STDC_WANT_LIB_EXT1__
-#endif
-#include <ctime>
 #include "cxxopts.hpp"
-#include "PTUFileHeader.h"
-#include "TTTRRecordProcessor.h"
-#include "RecordBuffer.h"
+#include "Conversion.h"
+#include "BatchMode.h"
+#include "Catalog.h"
 
 #ifdef _WIN32
 #include <io.h>
@@ -47,157 +34,76 @@ bool my_isatty()
 }
 #endif
 
-//#define	DOPERFORMANCEANALYSIS
-#ifdef DOPERFORMANCEANALYSIS
-#include <chrono>
-#endif // DOPERFORMANCEANALYSIS
-
-#pragma pack(8)
-
-extern int ExportIBWFile(std::ostream& os, uint32_t* histogram, int64_t pix_x,
-	int64_t pix_y, double res_space, double res_time, int64_t num_hist_channels,
-	int64_t max_export_channel, const std::string& wavename, time_t filedate);
-
 constexpr auto APP_NAME = "PTU2BIN", VERSION = "2.0";
 
-
-
-struct BinHeader {
-	uint32_t PixX, PixY;
-	float PixResol;
-	uint32_t TCSPCChannels;
-	float TimeResol;
-};
-
-// write histogram data in BIN format
-int ExportBinFile(std::ostream& os, uint32_t* histogram, int64_t pix_x, int64_t pix_y, double res_space, double res_time, int64_t num_hist_channels, int64_t max_used_channel)
-{
-	BinHeader bh{};
-	bh.PixX = (uint32_t)pix_x;
-	bh.PixY = (uint32_t)pix_y;
-	bh.PixResol = (float)res_space;
-	bh.TCSPCChannels = (uint32_t)max_used_channel;
-	bh.TimeResol = (float)(res_time * 1e9); // in ns
-	os.write((char*)& bh, sizeof(bh));
-	if (!os.good()) {
-		return 1;
-	}
-	for (int64_t y = 0; y < pix_y; ++y) {
-		for (int64_t x = 0; x < pix_x; ++x) {
-			os.write((char*)(histogram + y * pix_x * num_hist_channels + x * num_hist_channels), sizeof(uint32_t) * max_used_channel);
-			if (!os.good()) {
-				return 1;
-			}
-		}
-	}
-	return 0; // success
-}
-
-enum FRAME_TRIGGER_TYPE {
-	FRAMETRG_UNKNOW = 0,
-	FRAMETRG_AT_START = 1,
-	FRAMETRG_AT_STOP = 2
-};
-
-// It seems that a certain number of lines should be skipped when the PTU
-// file is processed. Here we define how many. In our system is 1 line.
-// I do not know yet if this is universally true. Might be a bug in SymphoTime
-// or be specific to our system (like misconfigured trigger).
-// AnalyzeTriggers can automatically detect if and how many lines
-// should be skipped and if frame trigger is valid and if it's at start or stop/end of frame
-void AnalyzeTriggers(RecordBuffer& buffer, const TTTRRecordProcessor& processor, const PTUFileHeader& fh, int& frame_trg_type, int64_t& lines_to_skip)
-{
-	int64_t total_linestarts{}, total_linestops{};
-		//total_frames{};
-	unsigned int TrgLineStartMask = 1 << (fh.trg_linestart - 1), TrgLineStopMask = 1 << (fh.trg_linestop - 1),
-		TrgFrameMask = 1 << (fh.trg_frame - 1);
-	frame_trg_type = FRAMETRG_UNKNOW, lines_to_skip = 0;
-
-	while (!buffer.noMoreData()) {
-		auto record = buffer.pop();
-		if (processor.isMarker(record)) {
-			auto marker = processor.markers(record);
-			if (!buffer.noMoreData()) {
-				// test if next record is also a marker event
-				auto next_record = buffer.peek();
-				if (processor.isMarker(next_record)) {
-					// we merge here independent of time to next trigger! Might cause problems.
-					next_record = buffer.pop();
-					marker |= processor.markers(next_record);
-
-#ifndef NDEBUG
-					if (processor.nsync(next_record) != processor.nsync(record))
-					{
-						auto DT = processor.nsync(next_record) - processor.nsync(record);
-						std::cout << "WARNING: merge with DT = " << DT << " (" <<
-							DT * fh.GlobRes << " s)" << std::endl;
-					}
-#endif // !NDEBUG
-				}
-			}
-			//if (marker & TrgFrameMask) {
-			//	++total_frames;
-			//}
-			if (marker & TrgLineStartMask) {
-				++total_linestarts;
-			}
-			if (marker & TrgLineStopMask) {
-				++total_linestops;
-			}
-			if (marker & TrgFrameMask){
-				if (total_linestarts != total_linestops) {
-					std::cout << "frame trigger out of sequence" << std::endl;
-				}
-				if (total_linestops == 0 && frame_trg_type != FRAMETRG_AT_START) {
-					frame_trg_type = FRAMETRG_AT_START;
-					lines_to_skip = 0;
-#ifndef NDEBUG
-					std::cout << "frame trigger at start, lines to skip " << lines_to_skip << std::endl;
-#endif // !NDEBUG
-					break;
-				}
-				if (frame_trg_type != FRAMETRG_AT_START && frame_trg_type!=FRAMETRG_AT_STOP) {
-					frame_trg_type = FRAMETRG_AT_STOP;
-					lines_to_skip = total_linestarts - fh.pix_y;
-#ifndef NDEBUG
-					std::cout << "frame trigger at end, lines to skip " << lines_to_skip << std::endl;
-#endif // !NDEBUG
-#ifdef NDEBUG
-					break;
-#endif // NDEBUG
-				}
-			}
-		}
-	}
-	buffer.rewind();
-}
-
-void parse(int argc, char** argv, std::string& infile, std::string& outfile, int& channelofinterest,
-	int64_t& first_frame, int64_t& last_frame, bool& ignore_frame_trigger, int64_t& lines_to_skip)
+// in batch mode, inputs holds the files/directories, otherwise inputs[0] is the infile
+// with expand set, infile is a sparse BIN file to be converted to outfile
+void parse(int argc, char** argv, std::vector<std::string>& inputs, std::string& outfile,
+	ConversionOptions& conversion, BatchOptions& batch, bool& expand)
 {
+	auto& channelofinterest = conversion.channelofinterest;
+	auto& frames = conversion.frames;
+	auto& ignore_frame_trigger = conversion.ignore_frame_trigger;
+	auto& lines_to_skip = conversion.lines_to_skip;
+	auto& use_mmap = conversion.use_mmap;
+	auto& num_threads = conversion.num_threads;
+	auto& use_index = conversion.use_index;
 	try {
 		cxxopts::Options options(APP_NAME, " - convert PTU to BIN or IBW");
-		options.positional_help("<infile> <outfile> [<channel#>]").show_positional_help();
+		options.positional_help(std::string("<infile> <outfile> [<channel#>]\n  or: ") + APP_NAME +
+			" --batch [options] <file or directory>...\n  or: " + APP_NAME +
+			" --catalog <index.csv|index.json> <file or directory>...").show_positional_help();
 		options.add_options()
 			("i,infile", "input file", cxxopts::value<std::string>(),"<infile>")
-			("o,outfile", "output file (use suffix '.ibw' for IBW format)", cxxopts::value<std::string>(),"<outfile>")
+			("o,outfile", "output file (use suffix '.ibw' for IBW format, '.sbin' for sparse BIN format)", cxxopts::value<std::string>(),"<outfile>")
 			("c,channel","detectorchannel (<=0: all, default: 2)",cxxopts::value<int>(),"<channel#>")
+			("channels", "histogram several channels in one pass, one outfile each, e.g. 1,2,sum (sum: all channels)", cxxopts::value<std::string>(), "<list>")
 			("f,first", "first frame (default 0)", cxxopts::value<int64_t>(),"<# 1st frame>")
 			("l,last", "last frame (default: last in file)", cxxopts::value<int64_t>(), "<# last frame>")
+			("frames", "list of frames to process, e.g. 3,7,10-20 (instead of first/last)", cxxopts::value<std::string>(), "<list>")
 			("ignore-frame-trigger", "set if frame trigger is unreliable")
 			("lines-to-skip", "lines to skip at start of frame", cxxopts::value<int64_t>(), "<#>")
+			("no-mmap", "read infile through buffered stream instead of memory mapping it")
+			("pipeline", "read, decode and bin on three threads (buffered reading instead of memory mapping)")
+			("threads", "number of threads used for decoding (0: all cores, default: 1)", cxxopts::value<unsigned int>(), "<#>")
+			("time-series", "do not sum up frames, write every <#> frames (default: 1) as one slice (BIN: numbered files, IBW: 4D wave)",
+				cxxopts::value<int64_t>()->implicit_value("1"), "<#>")
+			("phasor", "phasor mode: write intensity and G/S images of the given harmonics (default: 1) instead of histogram",
+				cxxopts::value<std::string>()->implicit_value("1"), "<list>")
+			("intensity", "quick-look mode: write intensity and mean arrival time images instead of histogram")
+			("gates", "gate mode: write one intensity image per Dtime gate instead of histogram, e.g. 0-2.5,2.5-12 (ns)",
+				cxxopts::value<std::string>(), "<list>")
+			("bin-xy", "bin <#> x <#> pixels into one", cxxopts::value<int64_t>(), "<#>")
+			("bin-t", "bin <#> Dtime channels into one", cxxopts::value<int64_t>(), "<#>")
+			("events", "event mode: write photons as events (one file per column: frame, y, x, dtime, channel) instead of histogram")
+			("macrotime", "event mode: also write the absolute macrotime (in sync periods)")
+			("event-filter", "event mode: write only photons of the selected frames and channels (default: all)")
+			("frame-step", "process only every <#>th frame (counting from the first selected frame)", cxxopts::value<int64_t>(), "<#>")
+			("max-memory", "max. memory for the histogram in MiB, a larger histogram is made in bands of lines (one pass over the file each)",
+				cxxopts::value<size_t>(), "<MiB>")
+			("huge-pages", "use transparent huge pages for the histogram (Linux)")
+			("index", "use frame index file <infile>.idx (create it if needed) to skip unused frames")
+			("expand", "convert sparse BIN file <infile> to <outfile> (BIN or IBW)")
+			("batch", "convert all given PTU files and all PTU files in the given directories (and their sub-directories); existing targets are not overwritten")
+			("ibw", "batch mode: write IBW instead of BIN files")
+			("jobs", "batch/catalog mode: number of files converted (read) in parallel (default: all cores)", cxxopts::value<unsigned int>(), "<#>")
+			("batch-memory", "batch mode: max. memory for histograms in MiB (default: half of physical memory)", cxxopts::value<size_t>(), "<MiB>")
+			("catalog", "read only the headers of all given PTU files and all PTU files in the given directories and write an index (CSV, or JSON with all tags; '-': stdout)",
+				cxxopts::value<std::string>(), "<file>")
 			("v,version", "print version")
 			/*("positional",
 				"Positional arguments: these are the arguments that are entered "
 				"without an option", cxxopts::value<std::vector<std::string>>())*/
 				("h,help", "print help");
+		options.add_options("positional") // not shown in help
+			("positional", "positional arguments", cxxopts::value<std::vector<std::string>>());
 
-		options.parse_positional({ "infile", "outfile", "channel"});
+		options.parse_positional({ "positional" });
 
 		auto result = options.parse(argc, argv);
 		if (result.count("help"))
 		{
-			std::cout << options.help() << std::endl;
+			std::cout << options.help({ "" }) << std::endl;
 			exit(0);
 		}
 		if (result.count("version"))
@@ -205,21 +111,123 @@ void parse(int argc, char** argv, std::string& infile, std::string& outfile, int
 			std::cout << APP_NAME << " Version " << VERSION << std::endl;
 			exit(0);
 		}
-		if (!result.count("infile") || !result.count("outfile")) {
-			std::cerr << "input and/or output file not specified (use option -h for help)" << std::endl;
-			exit(-1);
+		std::vector<std::string> positional;
+		if (result.count("positional")) {
+			positional = result["positional"].as<std::vector<std::string>>();
+		}
+		batch.enabled = result.count("batch") || result.count("catalog");
+		if (result.count("catalog")) {
+			batch.catalog = result["catalog"].as<std::string>();
+		}
+		if (batch.enabled) {
+			inputs = positional;
+			if (result.count("infile")) {
+				inputs.push_back(result["infile"].as<std::string>());
+			}
+			if (inputs.empty()) {
+				std::cerr << "no input files or directories specified (use option -h for help)" << std::endl;
+				exit(-1);
+			}
+			batch.ibw = result.count("ibw");
+			if (result.count("jobs")) {
+				batch.jobs = result["jobs"].as<unsigned int>();
+			}
+			if (result.count("batch-memory")) {
+				batch.memory_limit = result["batch-memory"].as<size_t>() * 1024 * 1024;
+			}
+		}
+		else {
+			// the classic positional arguments: <infile> <outfile> [<channel#>]
+			size_t pos = 0;
+			std::string infile;
+			if (result.count("infile")) {
+				infile = result["infile"].as<std::string>();
+			}
+			else if (pos < positional.size()) {
+				infile = positional[pos++];
+			}
+			if (result.count("outfile")) {
+				outfile = result["outfile"].as<std::string>();
+			}
+			else if (pos < positional.size()) {
+				outfile = positional[pos++];
+			}
+			if (infile.empty() || outfile.empty()) {
+				std::cerr << "input and/or output file not specified (use option -h for help)" << std::endl;
+				exit(-1);
+			}
+			inputs = { infile };
+			expand = result.count("expand");
+			if (!result.count("channel") && pos < positional.size()) {
+				try {
+					channelofinterest = std::stoi(positional[pos++]) - 1;
+				}
+				catch (const std::logic_error&) {
+					std::cerr << "invalid channel # '" << positional[pos - 1] << "'" << std::endl;
+					exit(-1);
+				}
+			}
+			if (pos < positional.size()) {
+				std::cerr << "too many arguments (use option -h for help)" << std::endl;
+				exit(-1);
+			}
 		}
-		infile = result["infile"].as<std::string>();
-		outfile = result["outfile"].as<std::string>();
 		if (result.count("channel")) {
 			channelofinterest = result["channel"].as<int>()-1;
 		}
+		if (result.count("channels")) {
+			if (result.count("channel")) {
+				std::cerr << "use either option 'channel' or 'channels'" << std::endl;
+				exit(-1);
+			}
+			conversion.channels.clear();
+			std::istringstream list(result["channels"].as<std::string>());
+			std::string item;
+			while (std::getline(list, item, ',')) {
+				int ch = SUM_OF_CHANNELS;
+				if (item != "sum") {
+					try {
+						ch = std::max(SUM_OF_CHANNELS, std::stoi(item) - 1);
+					}
+					catch (const std::logic_error&) {
+						std::cerr << "invalid channel '" << item << "' in channel list" << std::endl;
+						exit(-1);
+					}
+				}
+				if (std::find(conversion.channels.begin(), conversion.channels.end(), ch) == conversion.channels.end()) {
+					conversion.channels.push_back(ch);
+				}
+			}
+			if (conversion.channels.empty() || conversion.channels.size() > HistogramBinner::MAX_PLANES) {
+				std::cerr << "channel list must have 1 to " << HistogramBinner::MAX_PLANES << " entries" << std::endl;
+				exit(-1);
+			}
+		}
+		int64_t first_frame = 0, last_frame = std::numeric_limits<int64_t>::max();
 		if (result.count("first")) {
 			first_frame = result["first"].as<int64_t>();
 		}
 		if (result.count("last")) {
 			last_frame = result["last"].as<int64_t>();
 		}
+		if (last_frame < first_frame) {
+			std::cout << "WARNING: last frame < first frame, no frames will be processed"
+				<< std::endl;
+		}
+		frames = FrameSelection(first_frame, last_frame);
+		if (result.count("frames")) {
+			if (result.count("first") || result.count("last")) {
+				std::cerr << "use either option 'frames' or 'first'/'last'" << std::endl;
+				exit(-1);
+			}
+			try {
+				frames = FrameSelection::parse(result["frames"].as<std::string>());
+			}
+			catch (const std::exception& e) {
+				std::cerr << "error parsing frame list: " << e.what() << std::endl;
+				exit(-1);
+			}
+		}
 		ignore_frame_trigger = result.count("ignore-frame-trigger");
 		if (result.count("lines-to-skip")) {
 			lines_to_skip = result["lines-to-skip"].as<int64_t>();
@@ -228,334 +236,135 @@ void parse(int argc, char** argv, std::string& infile, std::string& outfile, int
 					<< std::endl;
 			}
 		}
-	}
-	catch (const cxxopts::exceptions::exception& e) {
-		std::cout << "error parsing options: " << e.what() << std::endl;
-		exit(-1);
-	}
-}
-
-int main(int argc, char** argv)
-{
-	std::string infilename, outfilename;
-	int channelofinterest = 1;
-	int64_t first_frame = 0, last_frame = std::numeric_limits<int64_t>::max(), lines_to_skip = 0;
-	bool ignore_frame_trigger{ false };
-	parse(argc, argv, infilename, outfilename, channelofinterest, first_frame, last_frame,
-		ignore_frame_trigger, lines_to_skip);
-	// check if we are running from a terminal
-#ifdef DOPERFORMANCEANALYSIS
-	bool isterminal = false;
-#else // DOPERFORMANCEANALYSIS
-	bool isterminal = my_isatty();
-#endif
-	std::cout << "infile: " << infilename << "\noutfile: " << outfilename << std::endl;
-	if (last_frame < first_frame) {
-		std::cout << "WARNING: last frame < first frame, no frames will be processed"
-			<< std::endl;
-	}
-	std::ifstream infile(infilename, std::ios::in | std::ios::binary);
-	PTUFileHeader fh;
-	TTTRRecordProcessor processor;
-	if (!infile.good()) {
-		std::cerr << "error opening infile" << std::endl;
-		exit(EXIT_FAILURE);
-	}
-	if (!fh.ProcessFile(infile)) {
-		std::cerr << "error processing file headers" << std::endl;
-		exit(EXIT_FAILURE);
-	}
-	if (!infile.good()) {
-		std::cerr << "error while reading file headers\n";
-		exit(EXIT_FAILURE);
-	}
-	if (fh.measurement_submode != 3) {
-		// NOTE: "Measurement_SubMode" is mandatory, so we assume it is set in PTU file 
-		std::cerr << "ERROR: Submode " << Measurement_SubModes.at(fh.measurement_submode) <<
-			" not supported. Must be 'Image'." << std::endl;
-		exit(EXIT_FAILURE);
-	}
-	if (fh.dimensions != 3 && fh.dimensions != -1) {
-		std::cerr << "ERROR: " << fh.dimensions << " dimensions not supported. Must be 3." << std::endl;
-		exit(EXIT_FAILURE);
-	}
-	if (!fh.allNeededPresent()) {
-		std::cerr << "ERROR: some data missing from PTU file header" << std::endl;
-		exit(EXIT_FAILURE);
-	}
-	if (fh.sin_correction != 0) {
-		std::cout << 
-			"NOTE: ImgHdr_SinCorrection is " << fh.sin_correction << '%' << std::endl;
-	}
-	//
-	// we are done checking the file header, now let's init processing
-	if (!processor.init(fh)) {
-		std::cerr << "Unexpected record type." << std::endl;
-		exit(EXIT_FAILURE);
-	}
-	if (processor.isT2mode() || fh.measurement_mode != 3) {
-		std::cerr << "Sorry, T2 mode not supported (working on it)." << std::endl;
-		exit(EXIT_FAILURE);
-	}
-	constexpr double MAX_TRIGGER_DIFF_SEC = 120e-6;
-	int max_trig_diff = 0;
-	if (fh.GlobRes > 1e-9) {
-		max_trig_diff = int(MAX_TRIGGER_DIFF_SEC / fh.GlobRes);
-	}
-	int num_useful_histo_ch = int(std::ceil(fh.GlobRes / fh.Resolution)) + 1; // TODO: check if ok for T2 data
-	std::cout << "estimated number of useful histogram channels: " << num_useful_histo_ch << std::endl;
-	std::cout << "total # records in file: " << fh.num_records << std::endl;
-	if (channelofinterest >= 0) {
-		std::cout << "Evaluating channel " << (channelofinterest + 1) << " only." << std::endl;
-	}
-	else
-	{
-		std::cout << "Evaluating all channels." << std::endl;
-	}
-
-
-	unsigned int TrgLineStartMask = 1 << (fh.trg_linestart - 1), TrgLineStopMask = 1 << (fh.trg_linestop - 1),
-		TrgFrameMask = 1 << (fh.trg_frame - 1);
-	bool isrecordingline = false, framehasstarted = false;
-
-	// place for temporary storage of line data
-	struct PixelTime {
-		unsigned int dtime;
-		int64_t pixeltime;
-	};
-	std::vector<PixelTime> pixeltimes;
-	pixeltimes.reserve(32768); // Perf. test shows only small effect of this
-
-	// space for histogramm data
-	size_t max_hist_channels = std::max(512, num_useful_histo_ch); // number of histogramm channels, same as max Dtime?
-	auto histogram = std::make_unique<uint32_t[]>(max_hist_channels * fh.pix_x * fh.pix_y);
-	uint32_t maxDtime = 0; // max val in histogram
-
-	int64_t lastlinestart = -1, lastlinestop = -1, lineduration = -1, linecounter = 0,
-		totallines = 0,
-		framecounter = 0, lastframetime = -1, linesprocessed = 0;
-	int frame_trg_type = FRAMETRG_UNKNOW;
-	int64_t frametrgcount = 0; // as a control we count the frame triggers
-	double sin_corr_scale{};
-	if (fh.sin_correction != 0) {
-		sin_corr_scale = std::sin(M_PI * fh.sin_correction / 200.0);
-	}
-
-#ifdef DOPERFORMANCEANALYSIS
-	auto start_time = std::chrono::steady_clock::now();
-#endif
-	// prepare input buffer
-	RecordBuffer buffer(infile, fh.num_records);
-
-	//////////////
-	// start processing of records
-	try {
-		if (!ignore_frame_trigger) {
-			AnalyzeTriggers(buffer, processor, fh, frame_trg_type, lines_to_skip);
+		use_mmap = !result.count("no-mmap");
+		conversion.pipeline = result.count("pipeline");
+		if (conversion.pipeline && result.count("threads")) {
+			std::cerr << "options 'pipeline' and 'threads' can not be combined" << std::endl;
+			exit(-1);
 		}
-		linecounter = -lines_to_skip;
-		if (frame_trg_type != FRAMETRG_AT_START) {
-			framehasstarted = true;
+		if (result.count("threads")) {
+			num_threads = result["threads"].as<unsigned int>();
+			if (num_threads == 0) {
+				num_threads = std::max(1u, std::thread::hardware_concurrency());
+			}
 		}
-		for (int64_t recnum = 0; recnum < fh.num_records; ++recnum) {
-			auto TTTRRecord = buffer.pop();
-			if (processor.isSpecial(TTTRRecord))
-			{
-				if (processor.processOverflow(TTTRRecord)) //overflow
-				{
-					continue;
+		use_index = result.count("index");
+		if (result.count("phasor")) {
+			std::istringstream list(result["phasor"].as<std::string>());
+			std::string item;
+			while (std::getline(list, item, ',')) {
+				int h = 0;
+				try {
+					h = std::stoi(item);
 				}
-				auto trigger = processor.markers(TTTRRecord);
-				if (!buffer.noMoreData()) {
-					// test if next record is also a marker event
-					auto next_record = buffer.peek();
-					if (processor.isMarker(next_record) &&
-						(processor.nsync(next_record) - processor.nsync(TTTRRecord) <= max_trig_diff)) {
-						next_record = buffer.pop();
-						++recnum;
-						trigger |= processor.markers(next_record); // merge marker events
-#ifndef NDEBUG
-						std::cout << "marker events merged" << std::endl;
-#endif // !NDEBUG
-					}
+				catch (const std::logic_error&) {
 				}
-				// for the time being, we assume that any special record that is not an overflow
-				// is a marker record.
-				//if ((channel >= 1) && (channel <= 15)) //This is true only for TimeHarp260 and similar!
-				//{
-				auto truensync = processor.truesync(TTTRRecord);
-				if ((trigger & TrgFrameMask) && frame_trg_type == FRAMETRG_AT_START) {
-					framehasstarted = true;
-					lastframetime = truensync;
-					//++frametrgcount;
-					linecounter = 0; // this also signals that line should be processed
+				if (h < 1) {
+					std::cerr << "invalid harmonic '" << item << "'" << std::endl;
+					exit(-1);
 				}
-				if (framehasstarted && (trigger & TrgLineStartMask)) {
-					++totallines;
-					if (linecounter >= 0) {
-						isrecordingline = true;
-						lastlinestart = truensync;
-					}
-					else {
-						++linecounter;
-					}
-				}
-				else if ((trigger & TrgLineStopMask) && isrecordingline) { // line ended
-					isrecordingline = false;
-					lastlinestop = truensync;
-					lineduration = lastlinestop - lastlinestart;
-					assert(linecounter < fh.pix_y);
-					// process line data:
-					if ((framecounter >= first_frame) && (framecounter <= last_frame) && (linecounter < fh.pix_y)) {
-						++linesprocessed;
-						uint32_t* lp = histogram.get() + linecounter * max_hist_channels * fh.pix_x;
-						for (const auto& pt : pixeltimes) {
-							int64_t x;
-							if (fh.sin_correction == 0) {
-								x = int64_t(pt.pixeltime) * fh.pix_x / lineduration;
-							}
-							else {
-								// apply sinusoidal correction
-								// I hope this is correct, since info from on this is scarce
-								double t_n = 2.0 * pt.pixeltime / lineduration - 1.0;
-								double phi = t_n * M_PI * fh.sin_correction / 200.0;
-								x = int64_t((std::sin(phi) / sin_corr_scale + 1.0) * fh.pix_x / 2.0);
-							}
-							x = std::max(int64_t(0), std::min(x, fh.pix_x - 1));
-							if (fh.is_bidirect && bool(linecounter & 1)) {
-								x = fh.pix_x - 1 - x;
-							}
-							auto dt = pt.dtime;
-							if (dt < max_hist_channels) {
-								++lp[x * max_hist_channels + dt];
-								maxDtime = std::max(dt, maxDtime);
-							}
-						}
-					}
-					pixeltimes.clear();
-					++linecounter;
-					if (linecounter == fh.pix_y) {
-						++framecounter;
-
-						// for unknown frame trigger we assume we are always recording
-						if (frame_trg_type != FRAMETRG_UNKNOW) { framehasstarted = false; }
-						linecounter = -lines_to_skip;  // skip lines if necessary (in fact, this will also be set if frame trigger got caught)
+				conversion.phasor_harmonics.push_back(h);
+			}
+			if (conversion.phasor_harmonics.empty() || result.count("time-series")) {
+				std::cerr << "phasor mode needs a list of harmonics and can not be combined with time series" << std::endl;
+				exit(-1);
+			}
+		}
+		conversion.intensity_mode = result.count("intensity");
+		if (conversion.intensity_mode && (result.count("phasor") || result.count("time-series"))) {
+			std::cerr << "intensity mode can not be combined with phasor mode or time series" << std::endl;
+			exit(-1);
+		}
+		if (result.count("gates")) {
+			std::istringstream list(result["gates"].as<std::string>());
+			std::string item;
+			while (std::getline(list, item, ',')) {
+				DtimeGate gate{ -1.0, -1.0 };
+				auto dash = item.find('-', 1);
+				try {
+					if (dash != std::string::npos) {
+						gate = { std::stod(item.substr(0, dash)), std::stod(item.substr(dash + 1)) };
 					}
 				}
-				if ((trigger & TrgFrameMask) && frame_trg_type == FRAMETRG_AT_STOP) {
-					framehasstarted = true;
-					lastframetime = truensync;
-					linecounter = -lines_to_skip;
+				catch (const std::logic_error&) {
 				}
-				if (trigger & TrgFrameMask) {
-					++frametrgcount;
+				if (gate.start < 0.0 || gate.end <= gate.start) {
+					std::cerr << "invalid gate '" << item << "', expected <start>-<end> in ns" << std::endl;
+					exit(-1);
 				}
-				//				}
+				conversion.gates.push_back(gate);
 			}
-			else // photon detected
-			{
-				auto channel = processor.channel(TTTRRecord);
-				if (isrecordingline && (framecounter >= first_frame) && (framecounter <= last_frame) &&
-					((channelofinterest < 0) || (channel == channelofinterest))) {
-					assert(linecounter >= 0);
-					int64_t pixeltime = processor.truesync(TTTRRecord) - lastlinestart;
-					// store for later use:
-					pixeltimes.push_back({ processor.dtime(TTTRRecord), pixeltime });
-				}
+			if (conversion.gates.empty() || conversion.gates.size() > GateImages::MAX_GATES) {
+				std::cerr << "gate mode needs a list of 1 to " << GateImages::MAX_GATES << " gates" << std::endl;
+				exit(-1);
 			}
-			if (isterminal && (recnum & 0x7ffff) == 0) { // show progress indicator only in terminal sessions
-				std::cout << 100 * recnum / fh.num_records << "% done\r" << std::flush; // NOTE: this has no significant effect on performance (tested)
+			if (result.count("phasor") || result.count("intensity") || result.count("time-series")) {
+				std::cerr << "gate mode can not be combined with phasor mode, intensity mode or time series" << std::endl;
+				exit(-1);
 			}
 		}
-	}
-	catch (std::exception& e) {
-		std::cerr << "ERROR: " << e.what() << std::endl;
-		exit(EXIT_FAILURE);
-	}
-#ifdef DOPERFORMANCEANALYSIS
-	auto end_time = std::chrono::steady_clock::now();
-	std::chrono::duration<double> diff = end_time - start_time;
-	auto duration = diff.count();
-	std::cout << "PERF-TEST: Time for execution: " << duration << " s (" << duration / fh.num_records
-		<< " s per record)" << std::endl;
-	std::cout << pixeltimes.capacity() << std::endl;
-#endif
-	infile.close();
-	std::cout << "first processed frame " << first_frame
-		<< " \ntotal frames " << framecounter << " (processed: " << linesprocessed/fh.pix_y
-		<< ")\ntotal lines " << totallines << " (processed: " << linesprocessed
-		<< ")" << std::endl;
-
-	std::cout << "max Dtime " << maxDtime << std::endl;
-	assert(lineduration > 0);
-	double microsec_lastpixeltime = double(lineduration) * fh.GlobRes * 1.0e6 / double(fh.pix_x);
-	// round dwell time to nearest 0.1 micros:
-	std::cout << "pixel dwell time " << std::round(microsec_lastpixeltime * 10.0) / 10.0 << " microseconds" << std::endl;
-	if (frametrgcount != framecounter) {
-		std::cout << "WARNING: unexpected number of frame triggers in file (" << frametrgcount << ")" << std::endl;
-	}
-	if (totallines != ((fh.pix_y + lines_to_skip) * framecounter)) {
-		std::cout << "WARNING: total lines in file do not match expected num. of lines" << std::endl;
-#ifndef NDEBUG
-		std::cout << "Lines per processed frame: " << double(totallines) / double(framecounter) <<
-			"\nLines per frame trigger: " << double(totallines) / double(frametrgcount) << std::endl;
-#endif // !NDEBUG
-
-	}
-
-	++maxDtime; // need to store one datapoint more than max Dtime
-
-	// decide on the file format for export depending on the file extension given in the command line
-	auto poslastdot = outfilename.find_last_of('.');
-	std::string extension("bin"); // default to bin file
-	if (poslastdot != std::string::npos) {
-		extension = outfilename.substr(poslastdot + 1);
-	}
-	bool exporting_ibw;
-	if (extension == "ibw") {
-		exporting_ibw = true;
-		std::cout << "\nExporting Igor binary wave." << std::endl;
-	}
-	else {
-		std::cout << "\nExporting bin file." << std::endl;
-		exporting_ibw = false;
-	}
-
-	std::cout << "Writing outfile." << std::endl;
-	std::ofstream outfile(outfilename.c_str(), std::ios::out | std::ios::binary);
-	if (!outfile.good()) {
-		std::cerr << " error opening outfile\n";
-		exit(EXIT_FAILURE);
-	}
-	int res = 0;
-	if (!exporting_ibw) {
-		res = ExportBinFile(outfile, histogram.get(), fh.pix_x, fh.pix_y, fh.PixResol, fh.Resolution, max_hist_channels, maxDtime);
-	}
-	else {
-		auto lastslash = outfilename.find_last_of("/\\");
-		std::string wavename("");
-		if (lastslash != std::string::npos) {
-			wavename = outfilename.substr(lastslash + 1, poslastdot - lastslash - 1);
+		if (result.count("bin-xy")) {
+			conversion.bin_xy = result["bin-xy"].as<int64_t>();
 		}
-		else {
-			wavename = outfilename.substr(0, poslastdot);
+		if (result.count("bin-t")) {
+			conversion.bin_t = result["bin-t"].as<int64_t>();
+		}
+		if (result.count("max-memory")) {
+			conversion.max_memory = result["max-memory"].as<size_t>() * 1024 * 1024;
+		}
+		conversion.huge_pages = result.count("huge-pages");
+		if (conversion.bin_xy < 1 || conversion.bin_t < 1) {
+			std::cerr << "binning factors must be >= 1" << std::endl;
+			exit(-1);
+		}
+		conversion.event_mode = result.count("events");
+		conversion.event_macrotime = result.count("macrotime");
+		conversion.event_filter = result.count("event-filter");
+		if (conversion.event_mode && (result.count("phasor") || result.count("intensity") || result.count("gates") ||
+			result.count("time-series"))) {
+			std::cerr << "event mode can not be combined with phasor, intensity or gate mode or time series" << std::endl;
+			exit(-1);
 		}
-		char firstchar = wavename.at(0);
-		if (!std::isalpha(firstchar) && firstchar!='_') {
-			wavename = "_" + wavename;
-			std::cout << "wavename amended -> " << wavename << std::endl;
+		if (result.count("frame-step")) {
+			frames.setStep(result["frame-step"].as<int64_t>());
+		}
+		if (result.count("time-series")) {
+			conversion.frames_per_slice = result["time-series"].as<int64_t>();
+			if (conversion.frames_per_slice < 1) {
+				std::cerr << "number of frames per slice must be >= 1" << std::endl;
+				exit(-1);
+			}
 		}
-		res = ExportIBWFile(outfile, histogram.get(), fh.pix_x, fh.pix_y, fh.PixResol, fh.Resolution, max_hist_channels,
-			maxDtime, wavename, fh.filedate);
 	}
-	if (res != 0) {
-		outfile.close();
-		std::cerr << "Error while writing outfile.\n";
-		exit(EXIT_FAILURE);
+	catch (const cxxopts::exceptions::exception& e) {
+		std::cout << "error parsing options: " << e.what() << std::endl;
+		exit(-1);
 	}
-	outfile.close();
-
-	std::cout << "Done." << std::endl;
-	exit(EXIT_SUCCESS);
 }
 
+int main(int argc, char** argv)
+{
+	std::vector<std::string> inputs;
+	std::string outfilename;
+	ConversionOptions options;
+	BatchOptions batch;
+	bool expand = false;
+	parse(argc, argv, inputs, outfilename, options, batch, expand);
+	if (!batch.catalog.empty()) {
+		return RunCatalog(inputs, batch.catalog, batch.jobs);
+	}
+	if (batch.enabled) {
+		return RunBatch(inputs, options, batch);
+	}
+	if (expand) {
+		return ExpandSparseBinFile(inputs.front(), outfilename, std::cout, std::cerr);
+	}
+	// check if we are running from a terminal
+#ifdef DOPERFORMANCEANALYSIS
+	options.show_progress = false;
+#else // DOPERFORMANCEANALYSIS
+	options.show_progress = my_isatty();
+#endif
+	ConversionBuffers buffers;
+	return ConvertFile(inputs.front(), outfilename, options, buffers, std::cout, std::cerr);
+}
@@ -1,8 +1,11 @@
 #pragma once
 #include <istream>
+#include <iostream>
 #include <array>
 #include <cstdint>
 #include <ctime>
+#include <string>
+#include "PTUTagTable.h"
 
 constexpr auto Measurement_SubModes =
 	std::array{ "Point(0)", "Point(1)", "Line", "Image" };
@@ -19,13 +22,16 @@ public:
 		PixResol;
 	bool is_bidirect;
 	time_t filedate;
+	std::string hw_type;
+	PTUTagTable tags; // all tags of the header
 
 	PTUFileHeader() : measurement_mode{ -1 }, measurement_submode{ -1 },
 		num_records{ -1 }, record_type{ -1 }, dimensions{ -1 },
 		sin_correction{ 0 }, pix_x{ -1 }, pix_y{ -1 },
 		trg_frame{ -1 }, trg_linestart{ -1 }, trg_linestop{ -1 },
 		Resolution{}, GlobRes{}, PixResol{}, is_bidirect{ false }, filedate{} {};
-	bool ProcessFile(std::istream& infile);
+	// header info goes to log, error messages to err
+	bool ProcessFile(std::istream& infile, std::ostream& log = std::cout, std::ostream& err = std::cerr);
 	bool allNeededPresent();
 };
 
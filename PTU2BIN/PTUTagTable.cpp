@@ -0,0 +1,274 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include "PTUTagTable.h"
+
+namespace {
+	const char FileTagEnd[] = "Header_End"; // Always appended as last tag (BLOCKEND)
+
+	// A Tag entry
+	struct TagHead {
+		char Ident[32]; // Identifier of the tag
+		int32_t Idx;    // Index for multiple tags or -1
+		uint32_t Typ;   // Type of tag ty..... see const section
+		int64_t TagValue; // Value of tag.
+	};
+
+	void AppendUTF8(std::string& s, uint32_t c)
+	{
+		if (c < 0x80) {
+			s += char(c);
+		}
+		else if (c < 0x800) {
+			s += char(0xC0 | (c >> 6));
+			s += char(0x80 | (c & 0x3F));
+		}
+		else if (c < 0x10000) {
+			s += char(0xE0 | (c >> 12));
+			s += char(0x80 | ((c >> 6) & 0x3F));
+			s += char(0x80 | (c & 0x3F));
+		}
+		else {
+			s += char(0xF0 | (c >> 18));
+			s += char(0x80 | ((c >> 12) & 0x3F));
+			s += char(0x80 | ((c >> 6) & 0x3F));
+			s += char(0x80 | (c & 0x3F));
+		}
+	}
+
+	// UTF-16 (little endian) to UTF-8, up to the first null character
+	std::string UTF16ToUTF8(const std::string& raw)
+	{
+		std::string s;
+		for (size_t i = 0; i + 1 < raw.size(); i += 2) {
+			uint32_t c = uint8_t(raw[i]) | (uint32_t(uint8_t(raw[i + 1])) << 8);
+			if (c == 0) {
+				break;
+			}
+			if (c >= 0xD800 && c < 0xDC00 && i + 3 < raw.size()) { // surrogate pair
+				uint32_t low = uint8_t(raw[i + 2]) | (uint32_t(uint8_t(raw[i + 3])) << 8);
+				if (low >= 0xDC00 && low < 0xE000) {
+					c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+					i += 2;
+				}
+			}
+			AppendUTF8(s, c);
+		}
+		return s;
+	}
+}
+
+const double epochdiff = 25569.0; // days between 30/12/1899 (OLE epoch) and 01/01/1970 (UNIX epoch)
+// convert OLE time, a.k.a. MS time to C time_t
+time_t OLEtime2time_t(double oatime)
+{
+	time_t res((time_t)((oatime - epochdiff) * 24.0 * 60.0 * 60.0));
+	return res;
+}
+
+std::string FormatUTCTime(time_t t, const char* format)
+{
+	tm time{};
+#ifdef _WIN32
+	gmtime_s(&time, &t);
+#else
+	gmtime_r(&t, &time);
+#endif
+	char buf[64]{};
+	std::strftime(buf, sizeof(buf), format, &time);
+	return buf;
+}
+
+
+double Int64ToDouble(int64_t tagval)
+{
+	static_assert(sizeof(double) == 8, "double ist not 8 bytes");
+	double t;
+	std::memcpy(&t, &tagval, 8);
+	return t;
+}
+
+uint64_t PTUTagTable::hash(std::string_view name, int32_t idx)
+{
+	uint64_t h = 14695981039346656037ull; // FNV-1a
+	for (char c : name) {
+		h = (h ^ uint8_t(c)) * 1099511628211ull;
+	}
+	return (h ^ uint32_t(idx)) * 1099511628211ull;
+}
+
+uint32_t PTUTagTable::addToPool(std::string_view s)
+{
+	auto pos = uint32_t(pool.size());
+	pool.append(s);
+	return pos;
+}
+
+void PTUTagTable::insert(uint32_t tagindex)
+{
+	if (2 * (tags.size() + 1) > slots.size()) { // keep load factor <= 1/2
+		std::vector<uint32_t> old(std::max<size_t>(64, 2 * slots.size()), 0);
+		old.swap(slots);
+		for (auto s : old) {
+			if (s != 0) {
+				insert(s - 1);
+			}
+		}
+	}
+	const auto& tag = tags[tagindex];
+	size_t mask = slots.size() - 1;
+	for (size_t i = hash(name(tag), tag.idx) & mask; ; i = (i + 1) & mask) {
+		if (slots[i] == 0) {
+			slots[i] = tagindex + 1;
+			return;
+		}
+		const auto& other = tags[slots[i] - 1];
+		if (other.idx == tag.idx && name(other) == name(tag)) {
+			return; // keep first occurrence
+		}
+	}
+}
+
+const PTUTag* PTUTagTable::find(std::string_view tagname, int32_t idx) const
+{
+	if (slots.empty()) {
+		return nullptr;
+	}
+	size_t mask = slots.size() - 1;
+	for (size_t i = hash(tagname, idx) & mask; slots[i] != 0; i = (i + 1) & mask) {
+		const auto& tag = tags[slots[i] - 1];
+		if (tag.idx == idx && name(tag) == tagname) {
+			return &tag;
+		}
+	}
+	return nullptr;
+}
+
+void PTUTagTable::clear()
+{
+	tags.clear();
+	pool.clear();
+	slots.clear();
+	version.clear();
+	complete = false;
+}
+
+bool PTUTagTable::read(std::istream& infile, std::string& error)
+{
+	clear();
+	// first, test if it is a valid file
+	char magic[8];
+	infile.read(magic, sizeof(magic));
+	if (!infile.good()) {
+		error = "error reading infile";
+		return false;
+	}
+	if (std::strncmp(magic, "PQTTTR", 6) != 0) {
+		error = "not a valid PTU file";
+		return false;
+	}
+	char Version[9]{};
+	if (!infile.read(Version, 8).good()) {
+		error = "error reading infile";
+		return false;
+	}
+	version = Version;
+	TagHead tghd{};
+	std::string raw;
+	while (infile.read((char*)&tghd, sizeof(tghd)).good()) {
+		PTUTag tag{ addToPool({ tghd.Ident, strnlen(tghd.Ident, sizeof(tghd.Ident)) }), 0,
+			tghd.Idx, tghd.Typ, tghd.TagValue, 0, 0 };
+		tag.name_len = uint32_t(pool.size() - tag.name);
+		switch (tghd.Typ)
+		{
+		case tyAnsiString:
+		case tyWideString:
+			if (tghd.TagValue < 0 || !infile.good()) {
+				break;
+			}
+			raw.assign(size_t(tghd.TagValue), '\0');
+			infile.read(raw.data(), tghd.TagValue);
+			if (tghd.Typ == tyWideString) {
+				raw = UTF16ToUTF8(raw);
+			}
+			else {
+				raw.resize(strnlen(raw.c_str(), raw.size()));
+			}
+			tag.text = addToPool(raw);
+			tag.text_len = uint32_t(raw.size());
+			break;
+		case tyFloat8Array:
+		case tyBinaryBlob:
+			// need to skip a few bytes, not really interested in the data right now
+			infile.seekg(tghd.TagValue, std::ios::cur);
+			break;
+		default:
+			break;
+		}
+		tags.push_back(tag);
+		insert(uint32_t(tags.size() - 1));
+		if (tghd.Typ == tyEmpty8 && strncmp(tghd.Ident, FileTagEnd, sizeof(FileTagEnd)) == 0) {
+			complete = true;
+			break; // all headers have been read
+		}
+	}
+	return true;
+}
+
+std::string PTUTagTable::qualifiedName(const PTUTag& tag) const
+{
+	std::string s(name(tag));
+	if (tag.idx >= 0) {
+		s += '(' + std::to_string(tag.idx) + ')';
+	}
+	return s;
+}
+
+bool PTUTagTable::isNumeric(const PTUTag& tag)
+{
+	switch (tag.type) {
+	case tyBool8:
+	case tyInt8:
+	case tyBitSet64:
+	case tyColor8:
+	case tyFloat8:
+	case tyFloat8Array:
+	case tyBinaryBlob:
+		return true;
+	default:
+		return false;
+	}
+}
+
+std::string PTUTagTable::formatDouble(double x)
+{
+	char buf[32]{};
+	std::snprintf(buf, sizeof(buf), "%.15g", x);
+	if (std::strtod(buf, nullptr) != x) {
+		std::snprintf(buf, sizeof(buf), "%.17g", x);
+	}
+	return buf;
+}
+
+std::string PTUTagTable::valueText(const PTUTag& tag) const
+{
+	switch (tag.type) {
+	case tyBool8:
+		return tag.value ? "1" : "0";
+	case tyFloat8:
+		return formatDouble(Int64ToDouble(tag.value));
+	case tyTDateTime:
+		return FormatUTCTime(OLEtime2time_t(Int64ToDouble(tag.value)));
+	case tyAnsiString:
+	case tyWideString:
+		return std::string(text(tag));
+	case tyEmpty8:
+		return {};
+	default: // integers, and the size of arrays and blobs
+		return std::to_string(tag.value);
+	}
+}
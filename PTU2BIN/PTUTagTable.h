@@ -0,0 +1,82 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+//
+// All tags of a PTU file header, read up to Header_End (the records are not touched).
+// Tags are kept in file order in a compact array, names and strings in one pool,
+// lookup by name (and index) is done through a hash table.
+
+#pragma once
+#include <cstdint>
+#include <ctime>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// TagTypes  (TTagHead.Typ)
+constexpr uint32_t
+tyEmpty8 = 0xFFFF0008,
+tyBool8 = 0x00000008,
+tyInt8 = 0x10000008,
+tyBitSet64 = 0x11000008,
+tyColor8 = 0x12000008,
+tyFloat8 = 0x20000008,
+tyTDateTime = 0x21000008,
+tyFloat8Array = 0x2001FFFF,
+tyAnsiString = 0x4001FFFF,
+tyWideString = 0x4002FFFF,
+tyBinaryBlob = 0xFFFFFFFF;
+
+struct PTUTag {
+	uint32_t name, name_len; // in pool
+	int32_t idx; // index for multiple tags or -1
+	uint32_t type; // ty...
+	int64_t value; // raw value, for strings, arrays and blobs their size in bytes
+	uint32_t text, text_len; // strings (as UTF-8) in pool
+};
+
+class PTUTagTable
+{
+	std::vector<PTUTag> tags;
+	std::string pool;
+	std::vector<uint32_t> slots; // hash table, tag index + 1 (0: empty)
+	std::string version;
+	bool complete{ false };
+
+	static uint64_t hash(std::string_view name, int32_t idx);
+	uint32_t addToPool(std::string_view s);
+	void insert(uint32_t tagindex);
+public:
+	// reads the tags from the start of the file up to and including Header_End,
+	// stops early if the stream fails (see hasHeaderEnd());
+	// returns false (and sets error) if it is not a PTU file
+	bool read(std::istream& infile, std::string& error);
+	void clear();
+	const std::string& fileVersion() const { return version; };
+	bool hasHeaderEnd() const { return complete; };
+
+	size_t size() const { return tags.size(); };
+	const PTUTag& operator[](size_t i) const { return tags[i]; };
+	std::vector<PTUTag>::const_iterator begin() const { return tags.begin(); };
+	std::vector<PTUTag>::const_iterator end() const { return tags.end(); };
+	// nullptr if there is no such tag
+	const PTUTag* find(std::string_view name, int32_t idx = -1) const;
+
+	std::string_view name(const PTUTag& tag) const { return { pool.data() + tag.name, tag.name_len }; };
+	std::string_view text(const PTUTag& tag) const { return { pool.data() + tag.text, tag.text_len }; };
+	// "Ident" or "Ident(idx)"
+	std::string qualifiedName(const PTUTag& tag) const;
+	// value as text, numbers unquoted (arrays and blobs: their size), date as ISO 8601 (UTC)
+	std::string valueText(const PTUTag& tag) const;
+	// true if valueText() is a number
+	static bool isNumeric(const PTUTag& tag);
+	// shortest text that reads back as the same value
+	static std::string formatDouble(double x);
+};
+
+// value of a tyFloat8 or tyTDateTime tag
+double Int64ToDouble(int64_t tagval);
+// convert OLE time, a.k.a. MS time to C time_t
+time_t OLEtime2time_t(double oatime);
+// t as UTC, formatted by strftime (default: ISO 8601)
+std::string FormatUTCTime(time_t t, const char* format = "%Y-%m-%dT%H:%M:%SZ");
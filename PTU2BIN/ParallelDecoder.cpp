@@ -0,0 +1,180 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+
+#include <vector>
+#include <algorithm>
+#include "ParallelDecoder.h"
+#include "RecordClassifier.h"
+#include "RunThreads.h"
+
+namespace {
+	struct MarkerRecord {
+		size_t index; // in records
+		int64_t truesync; // relative to start of chunk in step 1, absolute afterwards
+		uint32_t record;
+	};
+
+	struct ChunkScan {
+		int64_t oflcorrection{}; // total overflow correction within chunk
+		std::vector<MarkerRecord> markers;
+	};
+
+	// records [begin, end) belonging to a line
+	// (a line might consist of several segments if a line start trigger
+	// occurs while recording a line)
+	struct LineSegment {
+		size_t begin, end;
+		int64_t lastlinestart, oflcorrection; // at begin
+	};
+
+	struct LineJob {
+		int64_t linecounter, lineduration;
+		size_t first_segment, num_segments;
+	};
+}
+
+template<class Processor> void DecodeParallel(std::span<const uint32_t> records, Processor& processor,
+	LineFrameTracker& tracker, HistogramBinner& binner, int channelofinterest, int max_trig_diff,
+	unsigned int num_threads, MarkerIndex* index_builder)
+{
+	num_threads = std::max(1u, num_threads);
+	size_t numrecords = records.size();
+	size_t chunksize = (numrecords + num_threads - 1) / num_threads;
+	auto classifier = RecordClassifier::forProcessor<Processor>(channelofinterest);
+
+	// step 1: find overflows and markers
+	std::vector<ChunkScan> scans(num_threads);
+	RunThreads(num_threads, [&](unsigned int t) {
+		size_t begin = std::min(numrecords, t * chunksize), end = std::min(numrecords, begin + chunksize);
+		Processor p = processor;
+		p.resetOverflow();
+		auto& scan = scans[t];
+		RecordBlockClasses classes;
+		for (size_t blockstart = begin; blockstart < end; blockstart += RecordClassifier::BLOCKSIZE) {
+			classifier.classify(records.data() + blockstart, std::min(end - blockstart, RecordClassifier::BLOCKSIZE), classes);
+			for (auto s : classes.special) {
+				auto record = records[blockstart + s];
+				if (!p.processOverflow(record)) {
+					scan.markers.push_back({ blockstart + s, p.truesync(record), record });
+				}
+			}
+		}
+		scan.oflcorrection = p.overflowCorrection();
+		});
+
+	// step 2: prefix sum of overflows, run markers through tracker
+	std::vector<MarkerRecord> markers;
+	int64_t oflcorrection = processor.overflowCorrection();
+	for (auto& scan : scans) {
+		for (const auto& m : scan.markers) {
+			markers.push_back({ m.index, m.truesync + oflcorrection, m.record });
+		}
+		oflcorrection += scan.oflcorrection;
+		scan.markers = std::vector<MarkerRecord>();
+	}
+	std::vector<LineSegment> segments;
+	std::vector<LineJob> jobs;
+	size_t first_segment = 0;
+	bool line_open = false;
+	for (size_t k = 0; k < markers.size(); ++k) {
+		const auto& m = markers[k];
+		auto trigger = processor.markers(m.record);
+		size_t last_index = m.index;
+		// merge with next record if it is also a marker event
+		if (k + 1 < markers.size() && markers[k + 1].index == m.index + 1 &&
+			(processor.nsync(markers[k + 1].record) - processor.nsync(m.record) <= max_trig_diff)) {
+			trigger |= processor.markers(markers[k + 1].record);
+			last_index = m.index + 1;
+			++k;
+		}
+		auto framecounter = tracker.framecounter;
+		auto events = tracker.processMarker(trigger, m.truesync);
+		if (index_builder) {
+			int64_t markerofl = m.truesync - processor.nsync(m.record);
+			if (events & LineFrameTracker::LINE_STARTED) {
+				index_builder->addLine(m.index, m.truesync, markerofl, tracker.state());
+			}
+			if (tracker.framecounter != framecounter) {
+				index_builder->addFrame(last_index + 1, markerofl, tracker.state());
+			}
+		}
+		if (events & LineFrameTracker::LINE_STARTED) {
+			if (line_open) {
+				segments.back().end = m.index; // line start while recording
+			}
+			else {
+				first_segment = segments.size();
+				line_open = true;
+			}
+			segments.push_back({ last_index + 1, last_index + 1, m.truesync, m.truesync - processor.nsync(m.record) });
+		}
+		else if (events & LineFrameTracker::LINE_ENDED) {
+			segments.back().end = m.index;
+			line_open = false;
+			if (tracker.ended_line >= 0) {
+				jobs.push_back({ tracker.ended_line, tracker.lineduration, first_segment, segments.size() - first_segment });
+			}
+			else {
+				segments.resize(first_segment);
+			}
+		}
+	}
+	markers = std::vector<MarkerRecord>();
+	processor.setOverflowCorrection(oflcorrection);
+
+	// step 3: bin photons, each thread takes care of its own lines
+	std::vector<std::vector<uint32_t>> maxDtimes(num_threads);
+	std::vector<std::vector<PendingPhoton>> pending(num_threads);
+	RunThreads(num_threads, [&](unsigned int t) {
+		Processor p = processor;
+		HistogramBinner b = binner;
+		b.deferGrowth();
+		std::vector<PixelTime> pixeltimes;
+		RecordBlockClasses classes;
+		for (const auto& job : jobs) {
+			if (binner.imageLine(job.linecounter) % num_threads != t) {
+				continue;
+			}
+			pixeltimes.clear();
+			for (size_t s = job.first_segment; s < job.first_segment + job.num_segments; ++s) {
+				const auto& seg = segments[s];
+				p.setOverflowCorrection(seg.oflcorrection);
+				for (size_t blockstart = seg.begin; blockstart < seg.end; blockstart += RecordClassifier::BLOCKSIZE) {
+					size_t blockend = std::min(seg.end, blockstart + RecordClassifier::BLOCKSIZE), next = 0;
+					classifier.classify(records.data() + blockstart, blockend - blockstart, classes);
+					auto take_photons = [&](size_t upto) {
+						classes.forEachAccepted(next, upto, [&](size_t i) {
+							auto record = records[blockstart + i];
+							pixeltimes.push_back({ p.dtime(record), p.channel(record), p.truesync(record) - seg.lastlinestart });
+							});
+					};
+					for (auto s : classes.special) {
+						take_photons(s);
+						p.processOverflow(records[blockstart + s]);
+						next = s + 1;
+					}
+					take_photons(blockend - blockstart);
+				}
+			}
+			b.binLine(job.linecounter, job.lineduration, pixeltimes);
+		}
+		maxDtimes[t] = std::move(b.maxDtime);
+		pending[t] = std::move(b.pending);
+		});
+	for (const auto& m : maxDtimes) {
+		for (size_t p = 0; p < m.size(); ++p) {
+			binner.maxDtime[p] = std::max(binner.maxDtime[p], m[p]);
+		}
+	}
+	for (const auto& p : pending) {
+		binner.pending.insert(binner.pending.end(), p.begin(), p.end());
+	}
+	binner.flush(); // no copies are binning now
+}
+
+template void DecodeParallel(std::span<const uint32_t>, TTTRRecordProcessor<HydraHarpT3Format>&,
+	LineFrameTracker&, HistogramBinner&, int, int, unsigned int, MarkerIndex*);
+template void DecodeParallel(std::span<const uint32_t>, TTTRRecordProcessor<HydraHarpV1T3Format>&,
+	LineFrameTracker&, HistogramBinner&, int, int, unsigned int, MarkerIndex*);
+template void DecodeParallel(std::span<const uint32_t>, TTTRRecordProcessor<PicoHarpT3Format>&,
+	LineFrameTracker&, HistogramBinner&, int, int, unsigned int, MarkerIndex*);
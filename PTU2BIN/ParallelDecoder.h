@@ -0,0 +1,30 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+//
+// Multi-threaded decoding of the records of an image scan.
+
+#pragma once
+#include <cstdint>
+#include <span>
+#include "TTTRRecordProcessor.h"
+#include "LineFrameTracker.h"
+#include "HistogramBinner.h"
+#include "MarkerIndex.h"
+
+// Decodes all records using num_threads threads. The result is the same as
+// processing the records one by one: tracker holds the final line/frame state,
+// processor the final overflow correction and binner.maxDtime the max. Dtime
+// that went into each histogram plane. Photons that need a longer time axis are added
+// to binner.pending. Photons of channelofinterest (< 0: all channels) are passed
+// to the binner, which sorts them into its planes. If index_builder is given, frames and lines
+// are added to it (record numbers are relative to the start of records).
+// 1. each thread scans a chunk of records for overflows and markers
+// 2. a prefix sum over the overflows gives the absolute time of each marker,
+//    the markers are run through the tracker (serially), which yields the
+//    record ranges of all lines that go into the histogram
+// 3. the lines are binned in parallel, each thread owns a distinct set of
+//    image lines, so no locking or merging of histograms is needed
+// (instantiated for all T3 record formats)
+template<class Processor> void DecodeParallel(std::span<const uint32_t> records, Processor& processor,
+	LineFrameTracker& tracker, HistogramBinner& binner, int channelofinterest, int max_trig_diff,
+	unsigned int num_threads, MarkerIndex* index_builder = nullptr);
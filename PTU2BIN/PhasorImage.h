@@ -0,0 +1,80 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+//
+// Phasor (G/S) images, accumulated photon by photon instead of
+// from the full histogram. Per pixel, we keep the photon count and the
+// sums of cos and sin of the phase of each photon, for each harmonic.
+// The phase of a Dtime is taken from a table.
+
+#pragma once
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class PhasorImage
+{
+	size_t numpixels, channels, values_per_pixel; // values: cos, sin for each harmonic
+	std::vector<int> harmonic_list;
+	std::vector<double> table; // channels * values_per_pixel
+	std::vector<uint32_t> counts; // numpixels
+	std::vector<double> sums; // numpixels * values_per_pixel
+public:
+	PhasorImage() : numpixels{ 0 }, channels{ 0 }, values_per_pixel{ 0 } {};
+	PhasorImage(const PhasorImage&) = delete;
+	PhasorImage& operator=(const PhasorImage&) = delete;
+
+	// clear and set up for new image, Dtime 0 ... Channels-1 are used.
+	// The phase of Dtime is 2 pi h Dtime resolution / period for harmonic h.
+	void reset(size_t Numpixels, size_t Channels, const std::vector<int>& harmonics, double resolution, double period)
+	{
+		numpixels = Numpixels;
+		channels = Channels;
+		harmonic_list = harmonics;
+		values_per_pixel = 2 * harmonics.size();
+		table.resize(channels * values_per_pixel);
+		for (size_t dt = 0; dt < channels; ++dt) {
+			for (size_t h = 0; h < harmonics.size(); ++h) {
+				double phi = 2.0 * M_PI * harmonics[h] * double(dt) * resolution / period;
+				table[dt * values_per_pixel + 2 * h] = std::cos(phi);
+				table[dt * values_per_pixel + 2 * h + 1] = std::sin(phi);
+			}
+		}
+		counts.assign(numpixels, 0);
+		sums.assign(numpixels * values_per_pixel, 0.0);
+	};
+
+	size_t numPixels() const { return numpixels; };
+	const std::vector<int>& harmonics() const { return harmonic_list; };
+	size_t bytes() const { return counts.size() * sizeof(uint32_t) + sums.size() * sizeof(double); };
+
+	// count photon, returns false (and does not count) if dt is beyond the table.
+	// May be called concurrently for different pixels.
+	bool add(size_t pixel, uint32_t dt)
+	{
+		if (dt >= channels) {
+			return false;
+		}
+		++counts[pixel];
+		const double* t = table.data() + dt * values_per_pixel;
+		double* s = sums.data() + pixel * values_per_pixel;
+		for (size_t i = 0; i < values_per_pixel; ++i) {
+			s[i] += t[i];
+		}
+		return true;
+	};
+
+	const std::vector<uint32_t>& intensity() const { return counts; };
+	// G (or S, if sine) image of harmonic # h, 0 for pixels without photons
+	std::vector<float> image(size_t h, bool sine) const
+	{
+		std::vector<float> img(numpixels);
+		for (size_t p = 0; p < numpixels; ++p) {
+			if (counts[p] > 0) {
+				img[p] = float(sums[p * values_per_pixel + 2 * h + (sine ? 1 : 0)] / counts[p]);
+			}
+		}
+		return img;
+	};
+};
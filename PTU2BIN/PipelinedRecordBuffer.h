@@ -0,0 +1,143 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+//
+// Record buffer that is filled by a reader thread of its own, so waiting
+// for the file overlaps with decoding. The reader fills large blocks and
+// passes them on through a ring, the consumed blocks go back to the reader
+// through a second ring. (Same interface as RecordBuffer.)
+
+#pragma once
+#include <stdexcept>
+#include <cstdint>
+#include <istream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include "SpscRing.h"
+
+class PipelinedRecordBuffer
+{
+public:
+	static constexpr size_t BLOCK_RECORDS = size_t(1) << 18; // 1 MiB
+	static constexpr size_t NUM_BLOCKS = 16;
+private:
+	std::istream& infile;
+	size_t recordstotal, fileoffset;
+	// Both rings can hold all blocks, so the reader only waits for free blocks.
+	// An empty block tells that reading failed.
+	SpscRing<std::vector<uint32_t>> filled, free_blocks;
+	std::vector<uint32_t> current; // block being consumed
+	size_t idx, recordsremaining; // remaining: not yet handed out
+	std::atomic<bool> stop;
+	std::thread reader;
+
+	void read(size_t first_record)
+	{
+		for (size_t pos = first_record; pos < recordstotal;) {
+			auto block = free_blocks.pop();
+			if (stop.load(std::memory_order_relaxed)) {
+				// the reader only ever pushes to filled, stopReader() takes the block back from there
+				filled.push(std::move(block));
+				return;
+			}
+			block.resize(std::min(BLOCK_RECORDS, recordstotal - pos));
+			infile.read((char*)block.data(), sizeof(uint32_t) * block.size());
+			if (!infile.good()) {
+				block.clear();
+			}
+			bool failed = block.empty();
+			pos += block.size();
+			filled.push(std::move(block));
+			if (failed) {
+				return;
+			}
+		}
+	};
+	void startReader(size_t recordindex)
+	{
+		recordindex = std::min(recordindex, recordstotal);
+		infile.clear();
+		infile.seekg(fileoffset + recordindex * sizeof(uint32_t));
+		stop = false;
+		current.clear();
+		idx = 0;
+		recordsremaining = recordstotal - recordindex;
+		reader = std::thread(&PipelinedRecordBuffer::read, this, recordindex);
+	};
+	void stopReader()
+	{
+		if (!reader.joinable()) {
+			return;
+		}
+		stop = true;
+		// hand all blocks back, so a waiting reader wakes up and sees the stop flag
+		// (only this thread pushes to free_blocks, the reader to filled)
+		std::vector<uint32_t> block;
+		free_blocks.push(std::move(current));
+		while (filled.tryPop(block)) {
+			free_blocks.push(std::move(block));
+		}
+		reader.join();
+		while (filled.tryPop(block)) {
+			free_blocks.push(std::move(block));
+		}
+		current = free_blocks.pop(); // keeps the number of blocks in the rings constant
+		current.clear();
+	};
+	void nextBlock()
+	{
+		if (recordsremaining == 0) {
+			throw std::range_error("trying to read from empty buffer (no more data)");
+		}
+		free_blocks.push(std::move(current));
+		current = filled.pop();
+		idx = 0;
+		if (current.empty()) {
+			throw std::runtime_error("Error while reading TTTR records from infile. Unexpected end of file.");
+		}
+	};
+public:
+	PipelinedRecordBuffer(std::istream& InFile, size_t numrecords) : infile{ InFile },
+		recordstotal{ numrecords }, fileoffset{ size_t(InFile.tellg()) },
+		filled(NUM_BLOCKS), free_blocks(NUM_BLOCKS), idx{ 0 }, recordsremaining{ 0 }, stop{ false }
+	{
+		for (size_t i = 1; i < NUM_BLOCKS; ++i) {
+			std::vector<uint32_t> block;
+			block.reserve(BLOCK_RECORDS);
+			free_blocks.push(std::move(block));
+		}
+		current.reserve(BLOCK_RECORDS);
+		startReader(0);
+	};
+	PipelinedRecordBuffer(const PipelinedRecordBuffer&) = delete;
+	PipelinedRecordBuffer& operator=(const PipelinedRecordBuffer&) = delete;
+	~PipelinedRecordBuffer() { stopReader(); };
+
+	bool noMoreData() const { return recordsremaining == 0; };
+	void rewind() { // rewind to first record
+		seek(0);
+	};
+	void seek(size_t recordindex) { // continue with given record
+		stopReader();
+		startReader(recordindex);
+	};
+	// return and remove top element:
+	uint32_t pop() {
+		if (idx == current.size()) {
+			nextBlock();
+		}
+		--recordsremaining;
+		return current[idx++];
+	}
+	// return but not remove top element:
+	uint32_t peek() {
+		if (idx == current.size()) {
+			if (recordsremaining == 0) {
+				throw std::range_error("tried to peek past last record");
+			}
+			nextBlock();
+		}
+		return current[idx];
+	}
+};
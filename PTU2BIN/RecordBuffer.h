@@ -7,6 +7,8 @@
 #include <cstdint>
 #include <istream>
 #include <memory>
+#include <vector>
+#include <algorithm>
 
 constexpr size_t BUFFSIZE = 1024;
 class RecordBuffer
@@ -36,8 +38,12 @@ public:
 		fileoffset{ size_t(InFile.tellg()) }{};
 	bool noMoreData() const { return empty() && recordsremaining == 0; };
 	void rewind() { // rewind to first record
-		bufidx = 0; bufnumelements = 0; recordsremaining = recordstotal;
-		infile.seekg(fileoffset);
+		seek(0);
+	};
+	void seek(size_t recordindex) { // continue with given record
+		bufidx = 0; bufnumelements = 0; recordsremaining = recordstotal - std::min(recordindex, recordstotal);
+		infile.clear();
+		infile.seekg(fileoffset + recordindex * sizeof(uint32_t));
 	};
 	// return and remove top element:
 	uint32_t pop() {
@@ -58,3 +64,30 @@ public:
 	}
 };
 
+
+// Hands out records that have already been read (the prefix) before
+// continuing with the records from the underlying buffer.
+template<class Buffer> class PrefixedRecordBuffer
+{
+	std::vector<uint32_t> prefix;
+	size_t prefixidx;
+	Buffer& rest;
+public:
+	PrefixedRecordBuffer(std::vector<uint32_t>&& Prefix, Buffer& Rest) : prefix{ std::move(Prefix) },
+		prefixidx{ 0 }, rest{ Rest } {};
+	bool noMoreData() const { return prefixidx == prefix.size() && rest.noMoreData(); };
+	// return and remove top element:
+	uint32_t pop() {
+		if (prefixidx < prefix.size()) {
+			return prefix[prefixidx++];
+		}
+		return rest.pop();
+	}
+	// return but not remove top element:
+	uint32_t peek() {
+		if (prefixidx < prefix.size()) {
+			return prefix[prefixidx];
+		}
+		return rest.peek();
+	}
+};
@@ -0,0 +1,164 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+
+#include "RecordClassifier.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CLASSIFIER_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+	struct Masks {
+		uint32_t specialmask, channelmask, channelvalue;
+		bool allchannels;
+	};
+
+	// classifies records, word by word; kernel(records, masks, special, accepted)
+	// classifies 64 records at once and sets the bits in special and accepted
+	template<class Kernel> void ClassifyBlock(const uint32_t* records, size_t n, const Masks& m,
+		RecordBlockClasses& classes, Kernel&& kernel)
+	{
+		classes.special.clear();
+		classes.accepted.assign((n + 63) / 64, 0);
+		for (size_t word = 0; word * 64 < n; ++word) {
+			const uint32_t* r = records + word * 64;
+			size_t count = std::min<size_t>(64, n - word * 64);
+			uint64_t special = 0, accepted = 0;
+			if (count == 64) {
+				kernel(r, m, special, accepted);
+			}
+			else {
+				for (size_t i = 0; i < count; ++i) {
+					bool isspecial = (r[i] & m.specialmask) == m.specialmask;
+					bool isaccepted = !isspecial && (m.allchannels || (r[i] & m.channelmask) == m.channelvalue);
+					special |= uint64_t(isspecial) << i;
+					accepted |= uint64_t(isaccepted) << i;
+				}
+			}
+			classes.accepted[word] = accepted;
+			while (special) {
+				classes.special.push_back(uint32_t(word * 64 + std::countr_zero(special)));
+				special &= special - 1;
+			}
+		}
+	}
+
+	void KernelScalar(const uint32_t* r, const Masks& m, uint64_t& special, uint64_t& accepted)
+	{
+		for (size_t i = 0; i < 64; ++i) {
+			bool isspecial = (r[i] & m.specialmask) == m.specialmask;
+			bool isaccepted = !isspecial && (m.allchannels || (r[i] & m.channelmask) == m.channelvalue);
+			special |= uint64_t(isspecial) << i;
+			accepted |= uint64_t(isaccepted) << i;
+		}
+	}
+
+#ifdef CLASSIFIER_X86
+	void KernelSSE2(const uint32_t* r, const Masks& m, uint64_t& special, uint64_t& accepted)
+	{
+		const __m128i smask = _mm_set1_epi32(int(m.specialmask)),
+			cmask = _mm_set1_epi32(int(m.allchannels ? 0 : m.channelmask)),
+			cvalue = _mm_set1_epi32(int(m.allchannels ? 0 : m.channelvalue));
+		for (size_t i = 0; i < 64; i += 4) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(r + i));
+			__m128i s = _mm_cmpeq_epi32(_mm_and_si128(v, smask), smask);
+			__m128i c = _mm_cmpeq_epi32(_mm_and_si128(v, cmask), cvalue);
+			__m128i a = _mm_andnot_si128(s, c);
+			special |= uint64_t(_mm_movemask_ps(_mm_castsi128_ps(s))) << i;
+			accepted |= uint64_t(_mm_movemask_ps(_mm_castsi128_ps(a))) << i;
+		}
+	}
+
+	TARGET_AVX2 void KernelAVX2(const uint32_t* r, const Masks& m, uint64_t& special, uint64_t& accepted)
+	{
+		const __m256i smask = _mm256_set1_epi32(int(m.specialmask)),
+			cmask = _mm256_set1_epi32(int(m.allchannels ? 0 : m.channelmask)),
+			cvalue = _mm256_set1_epi32(int(m.allchannels ? 0 : m.channelvalue));
+		for (size_t i = 0; i < 64; i += 8) {
+			__m256i v = _mm256_loadu_si256((const __m256i*)(r + i));
+			__m256i s = _mm256_cmpeq_epi32(_mm256_and_si256(v, smask), smask);
+			__m256i c = _mm256_cmpeq_epi32(_mm256_and_si256(v, cmask), cvalue);
+			__m256i a = _mm256_andnot_si256(s, c);
+			special |= uint64_t(uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(s)))) << i;
+			accepted |= uint64_t(uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(a)))) << i;
+		}
+	}
+
+	bool CPUHasAVX2()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) {
+			return false;
+		}
+		__cpuid(info, 1);
+		constexpr int OSXSAVE = 1 << 27, AVX = 1 << 28;
+		if ((info[2] & (OSXSAVE | AVX)) != (OSXSAVE | AVX) || (_xgetbv(0) & 6) != 6) {
+			return false; // OS does not save AVX registers
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif // CLASSIFIER_X86
+}
+
+const char* SimdLevelName(SimdLevel level)
+{
+	switch (level) {
+	case SimdLevel::sse2: return "SSE2";
+	case SimdLevel::avx2: return "AVX2";
+	default: return "scalar";
+	}
+}
+
+SimdLevel BestSimdLevel()
+{
+#ifdef CLASSIFIER_X86
+	static const SimdLevel best = CPUHasAVX2() ? SimdLevel::avx2 : SimdLevel::sse2; // SSE2 is part of x86-64
+	return best;
+#else
+	return SimdLevel::scalar;
+#endif
+}
+
+RecordClassifier::RecordClassifier(uint32_t Specialmask, uint32_t Channelmask, uint32_t Channelshift,
+	int channelofinterest, SimdLevel Level) :
+	specialmask{ Specialmask }, channelmask{ Channelmask },
+	channelvalue{ uint32_t(channelofinterest) << Channelshift },
+	allchannels{ channelofinterest < 0 },
+	level{ std::min(Level, BestSimdLevel()) }
+{
+	if (!allchannels && uint32_t(channelofinterest) > (Channelmask >> Channelshift)) {
+		// channel can not be represented in record, accept none
+		channelmask = 0;
+		channelvalue = 1;
+	}
+}
+
+void RecordClassifier::classify(const uint32_t* records, size_t n, RecordBlockClasses& classes) const
+{
+	Masks m{ specialmask, channelmask, channelvalue, allchannels };
+	switch (level) {
+#ifdef CLASSIFIER_X86
+	case SimdLevel::avx2:
+		ClassifyBlock(records, n, m, classes, KernelAVX2);
+		break;
+	case SimdLevel::sse2:
+		ClassifyBlock(records, n, m, classes, KernelSSE2);
+		break;
+#endif // CLASSIFIER_X86
+	default:
+		ClassifyBlock(records, n, m, classes, KernelScalar);
+	}
+}
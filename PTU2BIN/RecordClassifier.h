@@ -0,0 +1,68 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+//
+// Bulk classification of TTTR records. Most records are photons, often on
+// channels we are not interested in. A block of records is classified at
+// once (vectorized if the CPU allows it), so the record processing code
+// only needs to look at special records (markers and overflows) one by one,
+// photons passing the channel filter can be processed in bulk.
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <bit>
+#include <algorithm>
+
+enum class SimdLevel {
+	scalar, sse2, avx2
+};
+
+const char* SimdLevelName(SimdLevel level);
+SimdLevel BestSimdLevel(); // best level supported by this CPU
+
+// result of classifying a block of records
+struct RecordBlockClasses {
+	std::vector<uint32_t> special; // indices of special records, ascending
+	std::vector<uint64_t> accepted; // bit i%64 of word i/64 set: record i is a photon passing the channel filter
+
+	// calls f(i) for all accepted photons with index from <= i < to
+	template<class F> void forEachAccepted(size_t from, size_t to, F&& f) const
+	{
+		while (from < to) {
+			size_t word = from / 64, bit = from % 64;
+			uint64_t bits = accepted[word] >> bit;
+			size_t n = std::min<size_t>(64 - bit, to - from);
+			if (n < 64) {
+				bits &= (uint64_t(1) << n) - 1;
+			}
+			while (bits) {
+				f(from + size_t(std::countr_zero(bits)));
+				bits &= bits - 1;
+			}
+			from += n;
+		}
+	};
+};
+
+class RecordClassifier
+{
+	uint32_t specialmask, channelmask, channelvalue;
+	bool allchannels;
+	SimdLevel level;
+public:
+	static constexpr size_t BLOCKSIZE = 4096; // records per block, multiple of 64
+
+	// channelofinterest < 0: accept all channels
+	RecordClassifier(uint32_t Specialmask, uint32_t Channelmask, uint32_t Channelshift,
+		int channelofinterest, SimdLevel Level = BestSimdLevel());
+	// set up for record format of processor
+	template<class Processor> static RecordClassifier forProcessor(int channelofinterest, SimdLevel Level = BestSimdLevel())
+	{
+		using F = typename Processor::format;
+		return RecordClassifier(F::specialmask, F::channelmask, F::channelshift, channelofinterest, Level);
+	};
+	SimdLevel simdLevel() const { return level; };
+	// classify n <= BLOCKSIZE records
+	void classify(const uint32_t* records, size_t n, RecordBlockClasses& classes) const;
+};
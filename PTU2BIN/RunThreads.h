@@ -0,0 +1,35 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+
+#pragma once
+#include <vector>
+#include <thread>
+#include <exception>
+
+// run f(thread_index) on num_threads threads (the calling thread being one of them),
+// rethrows the first exception
+template<class F> void RunThreads(unsigned int num_threads, F&& f)
+{
+	std::vector<std::exception_ptr> errors(num_threads);
+	auto guarded = [&](unsigned int t) {
+		try {
+			f(t);
+		}
+		catch (...) {
+			errors[t] = std::current_exception();
+		}
+	};
+	std::vector<std::thread> threads;
+	for (unsigned int t = 1; t < num_threads; ++t) {
+		threads.emplace_back(guarded, t);
+	}
+	guarded(0);
+	for (auto& th : threads) {
+		th.join();
+	}
+	for (auto& e : errors) {
+		if (e) {
+			std::rethrow_exception(e);
+		}
+	}
+}
@@ -0,0 +1,122 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+
+#include <cstring>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include "SparseBin.h"
+
+namespace {
+	constexpr char SPARSE_MAGIC[8] = { 'P','T','U','S','B','I','N','2' },
+		SPARSE_MAGIC_V1[8] = { 'P','T','U','S','B','I','N','1' };
+	constexpr size_t HEADER_SIZE_V1 = offsetof(SparseBinHeader, TimeResolution);
+	constexpr size_t ENTRY_SIZE = sizeof(uint16_t) + sizeof(uint32_t);
+	constexpr size_t CHUNK_ENTRIES = size_t(1) << 18; // entries staged before writing / per read
+}
+
+int ExportSparseBinFile(std::ostream& os, const CompactHistogram& histogram, int64_t pix_x, int64_t pix_y,
+	double res_space, double res_time, int64_t max_used_channel, time_t filedate)
+{
+	auto start = os.tellp();
+	SparseBinHeader sh{};
+	std::memcpy(sh.magic, SPARSE_MAGIC, sizeof(sh.magic));
+	sh.PixX = (uint32_t)pix_x;
+	sh.PixY = (uint32_t)pix_y;
+	sh.PixResol = (float)res_space;
+	sh.TCSPCChannels = (uint32_t)max_used_channel;
+	sh.TimeResol = (float)(res_time * 1e9); // in ns
+	sh.FileDate = filedate > 0 ? uint32_t(filedate) : 0;
+	sh.TimeResolution = res_time;
+	size_t numpixels = size_t(pix_x * pix_y);
+	std::vector<uint64_t> offsets(numpixels + 1);
+	// header and offsets are written again once the entries are known
+	os.write((const char*)&sh, sizeof(sh));
+	os.write((const char*)offsets.data(), sizeof(uint64_t) * offsets.size());
+	if (!os.good()) {
+		return 1;
+	}
+	std::vector<uint32_t> pixel_buffer(max_used_channel);
+	std::vector<char> entries;
+	entries.reserve(CHUNK_ENTRIES * ENTRY_SIZE);
+	uint64_t num_entries = 0;
+	for (size_t pixel = 0; pixel < numpixels; ++pixel) {
+		offsets[pixel] = num_entries;
+		histogram.readPixel(pixel, pixel_buffer.data(), max_used_channel);
+		for (size_t t = 0; t < pixel_buffer.size(); ++t) {
+			if (pixel_buffer[t] != 0) {
+				uint16_t dt = uint16_t(t);
+				char entry[ENTRY_SIZE];
+				std::memcpy(entry, &dt, sizeof(dt));
+				std::memcpy(entry + sizeof(dt), &pixel_buffer[t], sizeof(uint32_t));
+				entries.insert(entries.end(), entry, entry + ENTRY_SIZE);
+				++num_entries;
+			}
+		}
+		if (entries.size() >= CHUNK_ENTRIES * ENTRY_SIZE) {
+			os.write(entries.data(), entries.size());
+			entries.clear();
+		}
+	}
+	offsets[numpixels] = num_entries;
+	os.write(entries.data(), entries.size());
+	auto end = os.tellp();
+	sh.NumEntries = num_entries;
+	os.seekp(start);
+	os.write((const char*)&sh, sizeof(sh));
+	os.write((const char*)offsets.data(), sizeof(uint64_t) * offsets.size());
+	os.seekp(end);
+	return !os.good();
+}
+
+bool ReadSparseBinFile(std::istream& is, SparseBinHeader& header, CompactHistogram& histogram)
+{
+	header = SparseBinHeader{};
+	is.read((char*)&header, HEADER_SIZE_V1);
+	if (!is.good()) {
+		return false;
+	}
+	if (std::memcmp(header.magic, SPARSE_MAGIC_V1, sizeof(header.magic)) == 0) {
+		header.FileDate = 0; // reserved in version 1
+		header.TimeResolution = double(header.TimeResol) * 1e-9;
+	}
+	else if (std::memcmp(header.magic, SPARSE_MAGIC, sizeof(header.magic)) != 0 ||
+		!is.read((char*)&header.TimeResolution, sizeof(header.TimeResolution)).good()) {
+		return false;
+	}
+	size_t numpixels = size_t(header.PixX) * size_t(header.PixY), channels = header.TCSPCChannels;
+	if (channels == 0 || channels > 65536) {
+		return false;
+	}
+	std::vector<uint64_t> offsets(numpixels + 1);
+	is.read((char*)offsets.data(), sizeof(uint64_t) * offsets.size());
+	if (!is.good() || offsets.front() != 0 || offsets.back() != header.NumEntries ||
+		!std::is_sorted(offsets.begin(), offsets.end())) {
+		return false;
+	}
+	histogram.reset(numpixels, channels, channels);
+	std::vector<char> entries;
+	size_t pixel = 0;
+	for (uint64_t first = 0; first < header.NumEntries; first += CHUNK_ENTRIES) {
+		size_t n = size_t(std::min<uint64_t>(CHUNK_ENTRIES, header.NumEntries - first));
+		entries.resize(n * ENTRY_SIZE);
+		is.read(entries.data(), entries.size());
+		if (!is.good()) {
+			return false;
+		}
+		for (size_t i = 0; i < n; ++i) {
+			while (offsets[pixel + 1] <= first + i) {
+				++pixel;
+			}
+			uint16_t dt;
+			uint32_t count;
+			std::memcpy(&dt, entries.data() + i * ENTRY_SIZE, sizeof(dt));
+			std::memcpy(&count, entries.data() + i * ENTRY_SIZE + sizeof(dt), sizeof(count));
+			if (dt >= channels) {
+				return false;
+			}
+			histogram.set(pixel, dt, count);
+		}
+	}
+	return true;
+}
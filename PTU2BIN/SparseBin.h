@@ -0,0 +1,35 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+//
+// Sparse BIN format (.sbin): only the non-zero channels of the histogram are stored.
+// Layout (little endian):
+//   SparseBinHeader (the fields of the BIN header, plus a magic, the file date, the number of entries
+//   and the exact time resolution; version 1 files, magic "PTUSBIN1", end before TimeResolution)
+//   uint64_t offsets[PixX * PixY + 1] (index of the first entry of each pixel, pixels in BIN order)
+//   entries, 6 bytes each: uint16_t Dtime, uint32_t count (in increasing Dtime per pixel)
+
+#pragma once
+#include <cstdint>
+#include <ctime>
+#include <istream>
+#include <ostream>
+#include "CompactHistogram.h"
+
+struct SparseBinHeader {
+	char magic[8];
+	uint32_t PixX, PixY;
+	float PixResol;
+	uint32_t TCSPCChannels;
+	float TimeResol; // in ns
+	uint32_t FileDate; // of the PTU file, as time_t (0: unknown)
+	uint64_t NumEntries;
+	double TimeResolution; // in s (TimeResol is rounded to float)
+};
+static_assert(sizeof(SparseBinHeader) == 48, "unexpected padding");
+
+// write histogram data in sparse BIN format (os must be seekable), returns 0 on success
+int ExportSparseBinFile(std::ostream& os, const CompactHistogram& histogram, int64_t pix_x, int64_t pix_y,
+	double res_space, double res_time, int64_t max_used_channel, time_t filedate);
+
+// read sparse BIN file into histogram, returns false if the file is not valid
+bool ReadSparseBinFile(std::istream& is, SparseBinHeader& header, CompactHistogram& histogram);
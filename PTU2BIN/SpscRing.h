@@ -0,0 +1,75 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+//
+// Bounded ring buffer connecting one producer thread with one consumer thread.
+// No locks are used, a thread only waits (without spinning) if the ring is
+// full (push) or empty (pop).
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+#include <bit>
+#include <algorithm>
+
+template<class T> class SpscRing
+{
+	std::vector<T> slots;
+	size_t mask;
+	alignas(64) std::atomic<size_t> head; // next slot to pop, written by consumer
+	alignas(64) std::atomic<size_t> tail; // next slot to push, written by producer
+public:
+	// capacity is rounded up to a power of 2
+	explicit SpscRing(size_t capacity) : slots(std::bit_ceil(std::max<size_t>(capacity, 1))),
+		mask{ slots.size() - 1 }, head{ 0 }, tail{ 0 } {};
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+
+	size_t capacity() const { return slots.size(); };
+
+	// producer side
+	bool tryPush(T& value)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == slots.size()) {
+			return false;
+		}
+		slots[t & mask] = std::move(value);
+		tail.store(t + 1, std::memory_order_release);
+		tail.notify_one();
+		return true;
+	};
+	void push(T value)
+	{
+		while (!tryPush(value)) {
+			size_t h = head.load(std::memory_order_acquire);
+			if (tail.load(std::memory_order_relaxed) - h == slots.size()) {
+				head.wait(h, std::memory_order_acquire);
+			}
+		}
+	};
+
+	// consumer side
+	bool tryPop(T& value)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		value = std::move(slots[h & mask]);
+		head.store(h + 1, std::memory_order_release);
+		head.notify_one();
+		return true;
+	};
+	T pop()
+	{
+		T value;
+		while (!tryPop(value)) {
+			size_t t = tail.load(std::memory_order_acquire);
+			if (head.load(std::memory_order_relaxed) == t) {
+				tail.wait(t, std::memory_order_acquire);
+			}
+		}
+		return value;
+	};
+};
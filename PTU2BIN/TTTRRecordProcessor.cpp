@@ -18,32 +18,10 @@ rtTimeHarp260PT2 = 0x00010206,    // (SubID = $00 ,RecFmt: $01) (V1), T-Mode: $0
 rtMultiHarpNT3 = 0x00010307,    // (SubID = $00 ,RecFmt: $01) (V1), T-Mode: $02 (T3), HW: $07 (MultiHarp150N)
 rtMultiHarpNT2 = 0x00010207;    // (SubID = $00 ,RecFmt: $01) (V1), T-Mode: $02 (T2), HW: $07 (MultiHarp150N)
 
-constexpr auto THT3_record_types = std::array{ rtHydraHarpT3,
-rtHydraHarp2T3, rtTimeHarp260NT3, rtTimeHarp260PT3, rtMultiHarpNT3 };
-constexpr auto PHT3_record_types = std::array{ rtPicoHarpT3 };
-constexpr auto THT2_record_types = std::array{ rtHydraHarpT2,
-rtHydraHarp2T2, rtTimeHarp260NT2, rtTimeHarp260PT2, rtMultiHarpNT2 };
-constexpr auto PHT2_record_types = std::array{ rtPicoHarpT2 };
-
-constexpr uint32_t
-THT3_SpecialBitMask = 0x80000000,
-THT3_NSyncMask = 1023,
-THT3_DTimeShift = 10, THT3_DTimeMask = 32767 << THT3_DTimeShift,
-THT3_ChannelShift = 25, THT3_ChannelMask = 63 << THT3_ChannelShift,
-THT3_OverflowPeriod = 1024,
-THT2_SpecialBitMask = 0x80000000,
-THT2_TimetagMask = 0x1ffffff,
-THT2_ChannelShift = 25, THT2_ChannelMask = 63 << THT2_ChannelShift,
-THT2v1_OverflowPeriod = 33552000, THT2v2_OverflowPeriod = 33554432, // HydraHaprv1 uses different overflow!
-PHT3_SpecialBitMask = 0xf0000000,
-PHT3_NSyncMask = 0xffff,
-PHT3_DTimeShift = 16, PHT3_DTimeMask = 0xfff << PHT3_DTimeShift,
-PHT3_ChannelShift = 28, PHT3_ChannelMask = 0xf << PHT3_ChannelShift,
-PHT3_OverflowPeriod = 65536,
-PHT2_SpecialBitMask = PHT3_SpecialBitMask,
-PHT2_TimetagMask = 0xfffffff,
-PHT2_ChannelShift = 28, PHT2_ChannelMask = 0xf << PHT2_ChannelShift,
-PHT2_OverflowPeriod = 210698240;
+constexpr auto THT3_record_types = std::array{ rtHydraHarp2T3,
+rtTimeHarp260NT3, rtTimeHarp260PT3, rtMultiHarpNT3 };
+constexpr auto THT2_record_types = std::array{ rtHydraHarp2T2,
+rtTimeHarp260NT2, rtTimeHarp260PT2, rtMultiHarpNT2 };
 
 // We should be able to work with HydraHarp, MultiHarp and TimeHarp260 T3 Format
 template<std::size_t N> bool RecordTypeIsSupported(int64_t recordtype, const std::array<int64_t,N>& supported_record_types)
@@ -57,112 +35,25 @@ template<std::size_t N> bool RecordTypeIsSupported(int64_t recordtype, const std
 	return false;
 }
 
-
-// currently, we are implementing support for one hardware platform
-TTTRRecordProcessor::TTTRRecordProcessor() :specialmask{ THT3_SpecialBitMask },
-nsyncmask{ THT3_NSyncMask },
-dtimemask{ THT3_DTimeMask }, dtimeshift{ THT3_DTimeShift },
-channelmask{ THT3_ChannelMask }, channelshift{ THT3_ChannelShift },
-markermask{ THT3_ChannelMask }, markershift{ THT3_ChannelShift },
-overflowperiod{ THT3_OverflowPeriod }, oflcorrection{ 0 },
-record_type{ 0 },
-isT2{ false }
-{}
-
-// for now, only works for THT3 type records
-bool TTTRRecordProcessor::init(const PTUFileHeader& fh)
+RecordFormat GetRecordFormat(int64_t record_type)
 {
-	record_type = fh.record_type;
 	if (RecordTypeIsSupported(record_type, THT3_record_types)) {
-		return true;
+		return RecordFormat::HydraHarpT3;
 	}
-	else if (RecordTypeIsSupported(record_type, PHT3_record_types)) {
-		specialmask = PHT3_SpecialBitMask;
-		nsyncmask = PHT3_NSyncMask;
-		dtimemask = PHT3_DTimeMask;
-		dtimeshift = PHT3_DTimeShift;
-		channelmask = PHT3_ChannelMask;
-		channelshift = PHT3_ChannelShift;
-		markermask = PHT3_DTimeMask;
-		markershift = PHT3_DTimeShift;
-		overflowperiod = PHT3_OverflowPeriod;
-		return true;
-	}
-	else if (RecordTypeIsSupported(record_type, THT2_record_types)) {
-		isT2 = true;
-		specialmask = THT2_SpecialBitMask;
-		nsyncmask = THT2_TimetagMask;
-		dtimemask = 0; // T2 records have no Dtime
-		dtimeshift = 0;
-		channelmask = THT2_ChannelMask;
-		channelshift = THT2_ChannelShift;
-		if (record_type == rtHydraHarpT2) {
-			overflowperiod = THT2v1_OverflowPeriod;
-		}
-		else {
-			overflowperiod = THT2v2_OverflowPeriod;
-		}
-		return true;
+	else if (record_type == rtHydraHarpT3) {
+		return RecordFormat::HydraHarpV1T3;
 	}
-	else if (RecordTypeIsSupported(record_type, PHT2_record_types)) {
-		isT2 = true;
-		specialmask = PHT2_SpecialBitMask;
-		nsyncmask = PHT2_TimetagMask;
-		dtimemask = 0; // T2 records have no Dtime
-		dtimeshift = 0;
-		channelmask = PHT2_ChannelMask;
-		channelshift = PHT2_ChannelShift;
-		overflowperiod = PHT2_OverflowPeriod;
-		return true;
+	else if (record_type == rtPicoHarpT3) {
+		return RecordFormat::PicoHarpT3;
 	}
-	return false;
-}
-
-
-bool TTTRRecordProcessor::isMarker(uint32_t record) const
-{
-	if (isSpecial(record)) {
-		if ((record_type == rtPicoHarpT3 && dtime(record) == 0) ||
-			(record_type == rtPicoHarpT2 && (record & 0xf) == 0)) {
-			return false; // is overflow event
-		}
-		if (record_type != rtPicoHarpT3 && record_type != rtPicoHarpT2) {
-			if (channel(record) == 63) { // is overflow event
-				return false; // is overflow event
-			}
-		}
-		return true;
+	else if (RecordTypeIsSupported(record_type, THT2_record_types)) {
+		return RecordFormat::HydraHarpT2;
 	}
-	return false;
-}
-
-
-bool TTTRRecordProcessor::processOverflow(uint32_t record)
-{
-#ifndef NDEBUG
-	if (isSpecial(record)) { 
-#endif // !NDEBUG
-		if ((record_type == rtPicoHarpT3 && dtime(record) == 0) ||
-			(record_type == rtPicoHarpT2 && (record & 0xf) == 0)) {
-			oflcorrection += overflowperiod;
-			return true;
-		}
-		if (record_type != rtPicoHarpT3 && record_type != rtPicoHarpT2) {
-			if (channel(record) == 63) { // is overflow event
-				if (record_type != rtHydraHarpT3 && record_type != rtHydraHarpT2) {
-					oflcorrection += nsync(record) * overflowperiod; //note: for T2, nsync is in fact timetag
-				}
-				else { // always 1 overflow for old HydraHarp
-					oflcorrection += overflowperiod;
-				}
-				return true;
-			}
-		}
-#ifndef NDEBUG
+	else if (record_type == rtHydraHarpT2) {
+		return RecordFormat::HydraHarpV1T2;
 	}
-	else {
-		throw std::runtime_error("only valid for special records");
+	else if (record_type == rtPicoHarpT2) {
+		return RecordFormat::PicoHarpT2;
 	}
-#endif // !NDEBUG
-	return false;
+	return RecordFormat::unknown;
 }
@@ -8,34 +8,167 @@
 #endif // !NDEBUG
 #include"PTUFileHeader.h"
 
+// Record formats
+// Everything about a record format is known at compile time, so the
+// compiler can fold masks and shifts into the code processing the records.
 
-class TTTRRecordProcessor
+// TimeHarp260, MultiHarp and HydraHarp (V2) T3 records
+struct HydraHarpT3Format {
+	static constexpr auto name = "HydraHarp/TimeHarp260/MultiHarp T3";
+	static constexpr bool isT2 = false;
+	static constexpr uint32_t
+		specialmask = 0x80000000,
+		nsyncmask = 1023,
+		dtimeshift = 10, dtimemask = 32767 << dtimeshift,
+		channelshift = 25, channelmask = 63 << channelshift,
+		markershift = channelshift, markermask = channelmask;
+	static constexpr int64_t overflowperiod = 1024;
+	// record must be special:
+	static constexpr bool isOverflow(uint32_t record) { return (record & channelmask) == channelmask; }
+	// number of overflows in overflow record
+	static constexpr int64_t overflows(uint32_t record) { return record & nsyncmask; }
+};
+
+// old HydraHarp (V1) T3 records, always 1 overflow per overflow record
+struct HydraHarpV1T3Format : HydraHarpT3Format {
+	static constexpr auto name = "HydraHarp V1 T3";
+	static constexpr int64_t overflows(uint32_t) { return 1; }
+};
+
+struct PicoHarpT3Format {
+	static constexpr auto name = "PicoHarp T3";
+	static constexpr bool isT2 = false;
+	static constexpr uint32_t
+		specialmask = 0xf0000000,
+		nsyncmask = 0xffff,
+		dtimeshift = 16, dtimemask = 0xfff << dtimeshift,
+		channelshift = 28, channelmask = 0xf << channelshift,
+		markershift = dtimeshift, markermask = dtimemask; // for special records
+	static constexpr int64_t overflowperiod = 65536;
+	static constexpr bool isOverflow(uint32_t record) { return (record & dtimemask) == 0; }
+	static constexpr int64_t overflows(uint32_t) { return 1; }
+};
+
+// TimeHarp260, MultiHarp and HydraHarp (V2) T2 records
+struct HydraHarpT2Format {
+	static constexpr auto name = "HydraHarp/TimeHarp260/MultiHarp T2";
+	static constexpr bool isT2 = true;
+	static constexpr uint32_t
+		specialmask = 0x80000000,
+		nsyncmask = 0x1ffffff, // in fact, this is the timetag
+		dtimeshift = 0, dtimemask = 0, // T2 records have no Dtime
+		channelshift = 25, channelmask = 63 << channelshift,
+		markershift = channelshift, markermask = channelmask;
+	static constexpr int64_t overflowperiod = 33554432;
+	static constexpr bool isOverflow(uint32_t record) { return (record & channelmask) == channelmask; }
+	static constexpr int64_t overflows(uint32_t record) { return record & nsyncmask; }
+};
+
+// HydraHaprv1 uses different overflow!
+struct HydraHarpV1T2Format : HydraHarpT2Format {
+	static constexpr auto name = "HydraHarp V1 T2";
+	static constexpr int64_t overflowperiod = 33552000;
+	static constexpr int64_t overflows(uint32_t) { return 1; }
+};
+
+struct PicoHarpT2Format {
+	static constexpr auto name = "PicoHarp T2";
+	static constexpr bool isT2 = true;
+	static constexpr uint32_t
+		specialmask = 0xf0000000,
+		nsyncmask = 0xfffffff, // in fact, this is the timetag
+		dtimeshift = 0, dtimemask = 0, // T2 records have no Dtime
+		channelshift = 28, channelmask = 0xf << channelshift,
+		markershift = 0, markermask = 0xf; // for special records
+	static constexpr int64_t overflowperiod = 210698240;
+	static constexpr bool isOverflow(uint32_t record) { return (record & markermask) == 0; }
+	static constexpr int64_t overflows(uint32_t) { return 1; }
+};
+
+enum class RecordFormat {
+	unknown, HydraHarpT3, HydraHarpV1T3, PicoHarpT3,
+	HydraHarpT2, HydraHarpV1T2, PicoHarpT2
+};
+
+RecordFormat GetRecordFormat(int64_t record_type);
+inline bool IsT2Format(RecordFormat format)
+{
+	return format == RecordFormat::HydraHarpT2 || format == RecordFormat::HydraHarpV1T2 ||
+		format == RecordFormat::PicoHarpT2;
+}
+
+template<class Format> class TTTRRecordProcessor
 {
-	uint32_t specialmask,
-		nsyncmask,
-		dtimemask, dtimeshift,
-		channelmask, channelshift,
-		markermask, markershift;
-	int64_t overflowperiod, oflcorrection, record_type;
-	bool isT2;
+	int64_t oflcorrection;
 public:
-	TTTRRecordProcessor();
-	bool init(const PTUFileHeader& fh); // true if successful
-	bool isSpecial(uint32_t record) const { return (record & specialmask) == specialmask; };
-	bool isMarker(uint32_t record) const;
-	bool isT2mode() const { return isT2; };
-	bool processOverflow(uint32_t record); // true, if record was overflow (record must be special!))
-	void resetOverflow() { oflcorrection = 0; };
-	int nsync(uint32_t record) const { return int(record & nsyncmask); };
-	int64_t truesync(uint32_t record) const { return oflcorrection + nsync(record); };
-	uint32_t dtime(uint32_t record) const {
+	using format = Format;
+	TTTRRecordProcessor() : oflcorrection{ 0 } {};
+	static constexpr bool isT2mode() { return Format::isT2; };
+	static bool isSpecial(uint32_t record) { return (record & Format::specialmask) == Format::specialmask; };
+	static bool isMarker(uint32_t record) { return isSpecial(record) && !Format::isOverflow(record); };
+	bool processOverflow(uint32_t record) // true, if record was overflow (record must be special!))
+	{
 #ifndef NDEBUG
-		if (isT2) {
-			throw std::runtime_error("Dtime not defined in T2 mode");
+		if (!isSpecial(record)) {
+			throw std::runtime_error("only valid for special records");
 		}
 #endif // !NDEBUG
-		return (record & dtimemask) >> dtimeshift;
+		if (Format::isOverflow(record)) {
+			oflcorrection += Format::overflows(record) * Format::overflowperiod; //note: for T2, nsync is in fact timetag
+			return true;
+		}
+		return false;
+	};
+	void resetOverflow() { oflcorrection = 0; };
+	int64_t overflowCorrection() const { return oflcorrection; };
+	void setOverflowCorrection(int64_t correction) { oflcorrection = correction; };
+	static int nsync(uint32_t record) { return int(record & Format::nsyncmask); };
+	int64_t truesync(uint32_t record) const { return oflcorrection + nsync(record); };
+	static uint32_t dtime(uint32_t record) {
+		static_assert(!Format::isT2, "Dtime not defined in T2 mode");
+		return (record & Format::dtimemask) >> Format::dtimeshift;
 	};
-	uint32_t channel(uint32_t record) const { return (record & channelmask) >> channelshift; };
-	uint32_t markers(uint32_t record) const { return (record & markermask) >> markershift; };
+	static uint32_t channel(uint32_t record) { return (record & Format::channelmask) >> Format::channelshift; };
+	static uint32_t markers(uint32_t record) { return (record & Format::markermask) >> Format::markershift; };
 };
+
+// Calls f(processor) with a TTTRRecordProcessor for the record format
+// of the file, so all code using the processor is instantiated
+// once per format. Returns false if the format is not supported.
+template<class F> bool VisitRecordFormat(int64_t record_type, F&& f)
+{
+	switch (GetRecordFormat(record_type)) {
+	case RecordFormat::HydraHarpT3: {
+		TTTRRecordProcessor<HydraHarpT3Format> processor;
+		f(processor);
+		return true;
+	}
+	case RecordFormat::HydraHarpV1T3: {
+		TTTRRecordProcessor<HydraHarpV1T3Format> processor;
+		f(processor);
+		return true;
+	}
+	case RecordFormat::PicoHarpT3: {
+		TTTRRecordProcessor<PicoHarpT3Format> processor;
+		f(processor);
+		return true;
+	}
+	case RecordFormat::HydraHarpT2: {
+		TTTRRecordProcessor<HydraHarpT2Format> processor;
+		f(processor);
+		return true;
+	}
+	case RecordFormat::HydraHarpV1T2: {
+		TTTRRecordProcessor<HydraHarpV1T2Format> processor;
+		f(processor);
+		return true;
+	}
+	case RecordFormat::PicoHarpT2: {
+		TTTRRecordProcessor<PicoHarpT2Format> processor;
+		f(processor);
+		return true;
+	}
+	default:
+		return false;
+	}
+}
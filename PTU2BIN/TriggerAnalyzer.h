@@ -0,0 +1,102 @@
+// (c) 2021 - 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include "PTUFileHeader.h"
+#include "LineFrameTracker.h"
+
+// It seems that a certain number of lines should be skipped when the PTU
+// file is processed. Here we define how many. In our system is 1 line.
+// I do not know yet if this is universally true. Might be a bug in SymphoTime
+// or be specific to our system (like misconfigured trigger).
+// TriggerAnalyzer can automatically detect if and how many lines
+// should be skipped and if frame trigger is valid and if it's at start or stop/end of frame.
+// It is fed the records one by one while the main loop stages them, so no extra pass
+// over the file is needed. Detection is complete with the first frame trigger.
+template<class RecordProcessor> class TriggerAnalyzer
+{
+	const RecordProcessor& processor;
+	const PTUFileHeader& fh;
+	std::ostream& log;
+	unsigned int TrgLineStartMask, TrgLineStopMask, TrgFrameMask;
+	int64_t total_linestarts, total_linestops;
+	uint32_t pending_record; // marker record that might get merged with the next one
+	bool has_pending, is_done;
+
+	void evaluate(uint32_t marker)
+	{
+		if (marker & TrgLineStartMask) {
+			++total_linestarts;
+		}
+		if (marker & TrgLineStopMask) {
+			++total_linestops;
+		}
+		if (marker & TrgFrameMask) {
+			if (total_linestarts != total_linestops) {
+				log << "frame trigger out of sequence" << std::endl;
+			}
+			if (total_linestops == 0) {
+				frame_trg_type = FRAMETRG_AT_START;
+				lines_to_skip = 0;
+#ifndef NDEBUG
+				log << "frame trigger at start, lines to skip " << lines_to_skip << std::endl;
+#endif // !NDEBUG
+			}
+			else {
+				frame_trg_type = FRAMETRG_AT_STOP;
+				lines_to_skip = total_linestarts - fh.pix_y;
+#ifndef NDEBUG
+				log << "frame trigger at end, lines to skip " << lines_to_skip << std::endl;
+#endif // !NDEBUG
+			}
+			is_done = true;
+		}
+	}
+public:
+	int frame_trg_type;
+	int64_t lines_to_skip;
+
+	TriggerAnalyzer(const RecordProcessor& Processor, const PTUFileHeader& FH, std::ostream& Log) :
+		processor{ Processor }, fh{ FH }, log{ Log },
+		TrgLineStartMask{ 1u << (FH.trg_linestart - 1) }, TrgLineStopMask{ 1u << (FH.trg_linestop - 1) },
+		TrgFrameMask{ 1u << (FH.trg_frame - 1) },
+		total_linestarts{}, total_linestops{}, pending_record{}, has_pending{ false }, is_done{ false },
+		frame_trg_type{ FRAMETRG_UNKNOW }, lines_to_skip{ 0 } {};
+	bool done() const { return is_done; };
+	void feed(uint32_t record)
+	{
+		if (has_pending) {
+			has_pending = false;
+			auto marker = processor.markers(pending_record);
+			if (processor.isMarker(record)) {
+				// we merge here independent of time to next trigger! Might cause problems.
+				marker |= processor.markers(record);
+#ifndef NDEBUG
+				if (processor.nsync(record) != processor.nsync(pending_record))
+				{
+					auto DT = processor.nsync(record) - processor.nsync(pending_record);
+					log << "WARNING: merge with DT = " << DT << " (" <<
+						DT * fh.GlobRes << " s)" << std::endl;
+				}
+#endif // !NDEBUG
+				evaluate(marker);
+				return;
+			}
+			evaluate(marker);
+		}
+		else if (processor.isMarker(record)) {
+			pending_record = record;
+			has_pending = true;
+		}
+	};
+	// call when there are no more records
+	void finish()
+	{
+		if (has_pending) {
+			has_pending = false;
+			evaluate(processor.markers(pending_record));
+		}
+	};
+};
@@ -2,7 +2,14 @@
 #include <string>
 #include <memory>
 #include <cstring>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <cstddef>
+#include <limits>
 #include "export_igor_ibw.h"
+#include "CompactHistogram.h"
+#include "RunThreads.h"
 
 /*	Checksum(data,oldcksum,numbytes)
 
@@ -17,62 +24,183 @@ int Checksum(short* data, int oldcksum, int numbytes)
 	return oldcksum & 0xffff;
 }
 
-int ExportIBWFile(std::ostream& os, uint32_t* histogram, int64_t pix_x,
-	int64_t pix_y, double res_space, double res_time, int64_t num_hist_channels,
-	int64_t max_export_channel, const std::string& wavename, time_t filetime)
+namespace {
+	constexpr size_t TILE_PIXELS = 256, // pixels per tile, a tile (<= 32 KiB of counters) should stay in L1/L2
+		TILE_CHANNELS = 64, // time channels per tile
+		MAX_GROUP_BYTES = 64 * 1024 * 1024; // frames re-ordered before they are written
+
+	// Writes frames t0 ... t0 + num_frames - 1 (i.e. time channels) to out, frame by frame.
+	// Pixels are split into num_threads slices, each thread fills its slice of all frames.
+	// Within a slice, tiles of pixels x time channels are transposed, so counters are read
+	// and results are written in (mostly) sequential order.
+	void TransposeFrames(const CompactHistogram& histogram, size_t t0, size_t num_frames,
+		uint32_t* out, unsigned int num_threads)
+	{
+		const size_t numpixels = histogram.numPixels(), channels = histogram.numChannels();
+		const uint16_t* counters = histogram.counters();
+		size_t slice = (numpixels + num_threads - 1) / num_threads;
+		slice = (slice + TILE_PIXELS - 1) / TILE_PIXELS * TILE_PIXELS;
+		RunThreads(num_threads, [&](unsigned int thread) {
+			size_t pbegin = std::min(numpixels, thread * slice), pend = std::min(numpixels, pbegin + slice);
+			for (size_t p0 = pbegin; p0 < pend; p0 += TILE_PIXELS) {
+				size_t p1 = std::min(pend, p0 + TILE_PIXELS);
+				for (size_t tt = 0; tt < num_frames; tt += TILE_CHANNELS) {
+					size_t tt1 = std::min(num_frames, tt + TILE_CHANNELS);
+					for (size_t p = p0; p < p1; ++p) {
+						const uint16_t* c = counters + p * channels + t0;
+						for (size_t t = tt; t < tt1; ++t) {
+							out[t * numpixels + p] = c[t];
+						}
+					}
+				}
+			}
+			});
+		// add high parts of counters that went beyond 16 bit
+		for (const auto& s : histogram.spilledPixels()) {
+			for (size_t t = 0; t < num_frames; ++t) {
+				out[t * numpixels + s.first] += s.second[t0 + t] << 16;
+			}
+		}
+	}
+}
+
+// true if a wave of npnts elements can be written (its size in the header is 32 bit)
+bool IBWWaveFits(int64_t npnts, size_t element_size)
 {
-	BinHeader5 bh;
-	// make sure the packing of the structs is as expected:
-	static_assert(sizeof(bh) == 64, "wrong size of bh");
-	memset((void*)& bh, 0, sizeof(bh));
-	WaveHeader5 wh;
-	constexpr size_t numbytes_wh = offsetof(WaveHeader5, wData);
-	static_assert(numbytes_wh == 320, "wrong size of wh");
-	memset((void*)& wh, 0, sizeof(wh));
+	return npnts >= 0 && uint64_t(npnts) * element_size + offsetof(WaveHeader5, wData) <=
+		uint64_t(std::numeric_limits<int32_t>::max());
+}
 
-	auto npnts = pix_x * pix_y * max_export_channel;
+namespace {
+	// Writes the headers of a wave with num_dims dimensions, of size ndim, scaling
+	// delta and units units (one char each)
+	int WriteWaveHeaders(std::ostream& os, short type, size_t element_size, int num_dims, const int64_t* ndim,
+		const double* delta, const char* units, const std::string& wavename, time_t filetime)
+	{
+		BinHeader5 bh;
+		// make sure the packing of the structs is as expected:
+		static_assert(sizeof(bh) == 64, "wrong size of bh");
+		memset((void*)& bh, 0, sizeof(bh));
+		WaveHeader5 wh;
+		constexpr size_t numbytes_wh = offsetof(WaveHeader5, wData);
+		static_assert(numbytes_wh == 320, "wrong size of wh");
+		memset((void*)& wh, 0, sizeof(wh));
 
-	bh.version = 5;
-	bh.wfmSize = int32_t(numbytes_wh + sizeof(uint32_t) * npnts);
-	// we will calculate checksum later, all other entries in bh remain 0
+		int64_t npnts = 1;
+		for (int d = 0; d < num_dims; ++d) {
+			npnts *= std::max(int64_t(1), ndim[d]);
+		}
+		if (!IBWWaveFits(npnts, element_size)) {
+			return 1;
+		}
+
+		bh.version = 5;
+		bh.wfmSize = int32_t(numbytes_wh + element_size * npnts);
+		// we will calculate checksum later, all other entries in bh remain 0
+
+		// The 32bit limit might create a problem in the future... (Feb. 6th 2040?)
+		wh.creationDate = uint32_t(filetime + EPOCHDIFF_MAC_UNIX);
+		wh.modDate = wh.creationDate;
+		wh.type = type;
+		wavename.copy(wh.bname, MAX_WAVE_NAME5);
+		wh.whVersion = 1; // yes, for version 5 files files this smust be 1...
+		wh.npnts = int32_t(npnts);
+		for (int d = 0; d < num_dims; ++d) {
+			wh.dimUnits[d][0] = units[d];
+			wh.nDim[d] = int32_t(ndim[d]);
+		}
+		// The next hack is to avoid an unaligned access to 
+		// elements in the struct that should be 8 byte aligned
+		// (but are 4 byte aligned, 32bit legacy caode is that way...)
+		memcpy((void*)wh.sfA, (const void*)delta, num_dims * sizeof(double));
+		short cksum = Checksum((short*)& bh, 0, sizeof(bh));
+		cksum = Checksum((short*)& wh, cksum, numbytes_wh);
+		bh.checksum = -cksum;
+		os.write((char*)&bh, sizeof(bh));
+		os.write((char*)&wh, numbytes_wh);
+		return !os.good();
+	}
+}
 
-	// The 32bit limit might create a problem in the future... (Feb. 6th 2040?)
-	wh.creationDate = uint32_t(filetime + EPOCHDIFF_MAC_UNIX);
-	wh.modDate = wh.creationDate;
-	wh.type = NT_UNSIGNED | NT_I32;
-	wavename.copy(wh.bname, MAX_WAVE_NAME5);
-	wh.whVersion = 1; // yes, for version 5 files files this smust be 1...
-	wh.dimUnits[0][0] = 'm';
-	wh.dimUnits[1][0] = 'm';
-	wh.dimUnits[2][0] = 's';
+// Writes the headers of a wave of pix_x * pix_y * num_channels (time) points,
+// with num_slices > 0 a 4D wave with num_slices of these images.
+int WriteIBWHeader(std::ostream& os, int64_t pix_x, int64_t pix_y, double res_space, double res_time,
+	int64_t num_channels, int64_t num_slices, const std::string& wavename, time_t filetime)
+{
+	int64_t ndim[4]{ pix_x, pix_y, num_channels, num_slices };
+	double dimdelta[4]{ res_space * 1e-6, res_space * 1e-6, // res_space is in micrometer
+		res_time, 1.0 }; // slice #
+	return WriteWaveHeaders(os, NT_UNSIGNED | NT_I32, sizeof(uint32_t), num_slices > 0 ? 4 : 3, ndim, dimdelta, "mms",
+		wavename, filetime);
+}
 
-	wh.npnts = int32_t(npnts);
-	wh.nDim[0] = int32_t(pix_x);
-	wh.nDim[1] = int32_t(pix_y);
-	wh.nDim[2] = int32_t(max_export_channel);
-	// The next hack is to avoid an unaligned access to 
-	// elements in the struct that should be 8 byte aligned
-	// (but are 4 byte aligned, 32bit legacy caode is that way...)
-	double dimdelta[3];
-	dimdelta[0] = dimdelta[1] = res_space*1e-6; // res_space is in micrometer
-	dimdelta[2] = res_time;
-	memcpy((void*)wh.sfA, (void*)dimdelta, 3 * sizeof(double));
-	short cksum = Checksum((short*)& bh, 0, sizeof(bh));
-	cksum = Checksum((short*)& wh, cksum, numbytes_wh);
-	bh.checksum = -cksum;
-	os.write((char*)&bh, sizeof(bh));
-	os.write((char*)&wh, numbytes_wh);
-	auto npnts_per_frame = pix_x * pix_y;
-	auto frame_buffer = std::make_unique<uint32_t[]>(npnts_per_frame);
+// Writes an image (pix_x * pix_y), data is uint32_t or float
+template<class T> int ExportIBWImage(std::ostream& os, const T* data, int64_t pix_x, int64_t pix_y,
+	double res_space, const std::string& wavename, time_t filetime)
+{
+	static_assert(std::is_same_v<T, uint32_t> || std::is_same_v<T, float>, "unsupported wave type");
+	int64_t ndim[2]{ pix_x, pix_y };
+	double dimdelta[2]{ res_space * 1e-6, res_space * 1e-6 };
+	if (WriteWaveHeaders(os, std::is_same_v<T, float> ? short(NT_FP32) : short(NT_UNSIGNED | NT_I32), sizeof(T),
+		2, ndim, dimdelta, "mm", wavename, filetime) != 0) {
+		return 1;
+	}
+	os.write((const char*)data, sizeof(T) * pix_x * pix_y);
+	return !os.good();
+}
+template int ExportIBWImage(std::ostream&, const uint32_t*, int64_t, int64_t, double, const std::string&, time_t);
+template int ExportIBWImage(std::ostream&, const float*, int64_t, int64_t, double, const std::string&, time_t);
+
+// Writes time channels 0 ... num_channels - 1 of histogram, with time as the 3rd dimension.
+int WriteIBWImage(std::ostream& os, const CompactHistogram& histogram, int64_t num_channels,
+	unsigned int num_threads)
+{
 	// re-order data, to have time as the 3rd dimension
-	for (int64_t t = 0; t < max_export_channel; ++t) {
-		auto p = frame_buffer.get();
-		for (int64_t y = 0; y < pix_y; ++y) {
-			for (int64_t x = 0; x < pix_x; ++x) {
-				*p++ = histogram[t + x * num_hist_channels + y * num_hist_channels * pix_x];
-			}
+	// several frames (time channels) are re-ordered at once and written in one go
+	size_t npnts_per_frame = histogram.numPixels();
+	size_t group = std::clamp<size_t>(MAX_GROUP_BYTES / (sizeof(uint32_t) * std::max<size_t>(1, npnts_per_frame)),
+		1, std::max<int64_t>(1, num_channels));
+	std::vector<uint32_t> frame_buffer(group * npnts_per_frame);
+	num_threads = std::max(1u, num_threads);
+	for (size_t t = 0; t < size_t(num_channels); t += group) {
+		size_t num_frames = std::min(group, size_t(num_channels) - t);
+		TransposeFrames(histogram, t, num_frames, frame_buffer.data(), num_threads);
+		os.write((char*)frame_buffer.data(), sizeof(uint32_t) * npnts_per_frame * num_frames);
+	}
+	return !os.good();
+}
+
+// Writes time channels 0 ... num_channels - 1 of a band of image lines (first_line ...),
+// histogram holds the pixels of the band. The data of the wave (pix_x * pix_y * num_channels)
+// starts at data_start, the band goes to its place in each time channel.
+// At most max_buffer_bytes (but at least one time channel of the band) are used for re-ordering.
+int WriteIBWBand(std::ostream& os, std::streamoff data_start, const CompactHistogram& histogram,
+	int64_t pix_x, int64_t pix_y, int64_t first_line, int64_t num_channels, unsigned int num_threads,
+	size_t max_buffer_bytes)
+{
+	size_t npnts_per_frame = histogram.numPixels();
+	size_t group = std::clamp<size_t>(std::min(MAX_GROUP_BYTES, max_buffer_bytes) /
+		(sizeof(uint32_t) * std::max<size_t>(1, npnts_per_frame)), 1, std::max<int64_t>(1, num_channels));
+	std::vector<uint32_t> frame_buffer(group * npnts_per_frame);
+	num_threads = std::max(1u, num_threads);
+	for (size_t t = 0; t < size_t(num_channels); t += group) {
+		size_t num_frames = std::min(group, size_t(num_channels) - t);
+		TransposeFrames(histogram, t, num_frames, frame_buffer.data(), num_threads);
+		for (size_t f = 0; f < num_frames; ++f) {
+			os.seekp(data_start + std::streamoff(sizeof(uint32_t) * ((t + f) * pix_y + first_line) * pix_x));
+			os.write((char*)(frame_buffer.data() + f * npnts_per_frame), sizeof(uint32_t) * npnts_per_frame);
 		}
-		os.write((char*)frame_buffer.get(), sizeof(uint32_t) * npnts_per_frame);
 	}
 	return !os.good();
 }
+
+int ExportIBWFile(std::ostream& os, const CompactHistogram& histogram, int64_t pix_x,
+	int64_t pix_y, double res_space, double res_time,
+	int64_t max_export_channel, const std::string& wavename, time_t filetime,
+	unsigned int num_threads)
+{
+	if (WriteIBWHeader(os, pix_x, pix_y, res_space, res_time, max_export_channel, 0, wavename, filetime) != 0) {
+		return 1;
+	}
+	return WriteIBWImage(os, histogram, max_export_channel, num_threads);
+}
@@ -2,6 +2,7 @@
 #pragma once
 #include <cstdint>
 
+constexpr auto NT_FP32 = 0x02;		// 32 bit fp numbers.;
 constexpr auto NT_I32 = 0x20;		// 32 bit integer numbers. Requires Igor Pro 2.0 or later.;
 constexpr auto NT_UNSIGNED = 0x40;	// Makes above signed integers unsigned. Requires Igor Pro 3.0 or later.;
 
@@ -0,0 +1,111 @@
+// (c) 2024 Christian R. Halaszovich
+// (See LICENSE.txt for licensing information.)
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include "libptu.h"
+#include "EventReader.h"
+#include "Conversion.h"
+
+static_assert(sizeof(ptu_event) == sizeof(ScanEvent) && offsetof(ptu_event, macrotime) == offsetof(ScanEvent, macrotime) &&
+	offsetof(ptu_event, frame) == offsetof(ScanEvent, frame) && offsetof(ptu_event, x) == offsetof(ScanEvent, x) &&
+	offsetof(ptu_event, y) == offsetof(ScanEvent, y) && offsetof(ptu_event, dtime) == offsetof(ScanEvent, dtime) &&
+	offsetof(ptu_event, channel) == offsetof(ScanEvent, channel) && offsetof(ptu_event, type) == offsetof(ScanEvent, type),
+	"ptu_event and ScanEvent must have the same layout");
+
+struct ptu_reader {
+	EventReader reader;
+};
+
+namespace {
+	thread_local std::string last_error;
+
+	int fail(const std::string& message)
+	{
+		last_error = message;
+		return -1;
+	}
+}
+
+extern "C" {
+
+ptu_reader* ptu_open(const char* filename, int channel)
+{
+	try {
+		return new ptu_reader{ EventReader(filename, channel) };
+	}
+	catch (const std::exception& e) {
+		fail(e.what());
+		return nullptr;
+	}
+}
+
+void ptu_close(ptu_reader* reader)
+{
+	delete reader;
+}
+
+int ptu_image_info(const ptu_reader* reader, int64_t* width, int64_t* height,
+	double* dtime_resolution, double* sync_resolution, double* pixel_resolution)
+{
+	if (!reader) {
+		return fail("no reader");
+	}
+	const auto& fh = reader->reader.header();
+	if (width) *width = fh.pix_x;
+	if (height) *height = fh.pix_y;
+	if (dtime_resolution) *dtime_resolution = fh.Resolution;
+	if (sync_resolution) *sync_resolution = fh.GlobRes;
+	if (pixel_resolution) *pixel_resolution = fh.PixResol;
+	return 0;
+}
+
+int64_t ptu_read_events(ptu_reader* reader, ptu_event* events, size_t capacity)
+{
+	if (!reader) {
+		return fail("no reader");
+	}
+	try {
+		return int64_t(reader->reader.read({ reinterpret_cast<ScanEvent*>(events), capacity }));
+	}
+	catch (const std::exception& e) {
+		return fail(e.what());
+	}
+}
+
+const char* ptu_last_error(void)
+{
+	return last_error.c_str();
+}
+
+int ptu_convert(const char* infile, const char* outfile, int channel, unsigned int num_threads,
+	char* log, size_t log_size)
+{
+	ConversionOptions options;
+	options.channelofinterest = channel;
+	options.num_threads = num_threads > 0 ? num_threads : 1;
+	ConversionBuffers buffers;
+	std::ostringstream report, err;
+	int result = EXIT_FAILURE;
+	try {
+		result = ConvertFile(infile, outfile, options, buffers, report, err);
+	}
+	catch (const std::exception& e) {
+		err << e.what() << '\n';
+	}
+	if (log && log_size > 0) {
+		auto text = report.str() + err.str();
+		auto n = std::min(text.size(), log_size - 1);
+		std::memcpy(log, text.data(), n);
+		log[n] = '\0';
+	}
+	if (result != EXIT_SUCCESS) {
+		return fail(err.str().empty() ? "conversion failed" : err.str());
+	}
+	return 0;
+}
+
+}
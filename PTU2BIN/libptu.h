@@ -0,0 +1,50 @@
+/* (c) 2024 Christian R. Halaszovich */
+/* (See LICENSE.txt for licensing information.) */
+/*
+ * C interface of libptu, e.g. for use with Python ctypes.
+ * Functions returning int return 0 on success; on error, ptu_last_error()
+ * tells what went wrong (per thread).
+ */
+
+#ifndef LIBPTU_H
+#define LIBPTU_H
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* same layout as ScanEvent (EventReader.h) */
+typedef struct ptu_event {
+	int64_t macrotime; /* overflow corrected, in sync periods */
+	uint32_t frame;
+	uint16_t x, y;
+	uint16_t dtime;
+	uint8_t channel; /* 0 based */
+	uint8_t type; /* PTU_PHOTON, PTU_LINE_END or PTU_FRAME_END */
+} ptu_event;
+
+enum { PTU_PHOTON = 0, PTU_LINE_END = 1, PTU_FRAME_END = 2 };
+
+typedef struct ptu_reader ptu_reader;
+
+/* channel is 0 based, < 0: all channels; returns NULL on error */
+ptu_reader* ptu_open(const char* filename, int channel);
+void ptu_close(ptu_reader* reader);
+/* image size in pixels, resolutions in s (Dtime and sync period) and um (pixel) */
+int ptu_image_info(const ptu_reader* reader, int64_t* width, int64_t* height,
+	double* dtime_resolution, double* sync_resolution, double* pixel_resolution);
+/* reads up to capacity events, returns their number (0: no more events) or -1 on error */
+int64_t ptu_read_events(ptu_reader* reader, ptu_event* events, size_t capacity);
+const char* ptu_last_error(void);
+
+/* converts infile to outfile (like PTU2BIN infile outfile), channel is 0 based,
+ * < 0: all channels; the report is copied to log (if not NULL, truncated to log_size) */
+int ptu_convert(const char* infile, const char* outfile, int channel, unsigned int num_threads,
+	char* log, size_t log_size);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* LIBPTU_H */
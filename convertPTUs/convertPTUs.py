@@ -43,6 +43,15 @@ for o, a in opts:
         input()
         sys.exit(0)
 
+if capturetofile:
+    # PTU2BIN converts all files itself, several files in parallel
+    res=subprocess.run([toolcmd,"--batch",".","-c",str(defaultchannel)])
+    if res.returncode != 0:
+        print("An error occured while converting some of the files.")
+    print("Press RETURN")
+    input()
+    sys.exit(res.returncode)
+
 filelist=glob.glob('**/*.ptu', recursive=True)
 print("Found %i PTU files to convert."%len(filelist))
 for fn in filelist: